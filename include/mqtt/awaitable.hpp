@@ -0,0 +1,531 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_AWAITABLE_HPP)
+#define MQTT_AWAITABLE_HPP
+
+#include <boost/asio/detail/config.hpp>
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/any.hpp>
+#include <mqtt/buffer.hpp>
+#include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/property_variant.hpp>
+#include <mqtt/publish.hpp>
+#include <mqtt/reason_code.hpp>
+#include <mqtt/subscribe_options.hpp>
+
+namespace MQTT_NS {
+
+namespace as = boost::asio;
+
+/**
+ * @brief C++20 coroutine interface of an endpoint
+ *
+ * awaitable_endpoint wraps a connected endpoint (async_client or server endpoint)
+ * and provides co_await-able publish, subscribe, unsubscribe, and receive.
+ * The operations complete when the corresponding response packet arrives.
+ *
+ * The completion handlers of pending operations are stored as asio's concrete
+ * use_awaitable handler types keyed by packet id, so no std::function is allocated
+ * per operation. asio recycles the coroutine frames per thread.
+ *
+ * The constructor replaces the following handlers of the endpoint:
+ * publish, puback, pubcomp, suback, unsuback (and their v5 variants), close, and error.
+ * When the endpoint is closed, all pending operations complete with the error,
+ * receive() throws boost::asio::error::eof on a normal close.
+ *
+ * All operations and the endpoint's handlers must run on the same thread (or strand).
+ *
+ * This header is available only if the compiler supports coroutines
+ * (BOOST_ASIO_HAS_CO_AWAIT is defined).
+ *
+ * @tparam Endpoint callable_overlay of the endpoint type. e.g. MQTT_NS::server<>::endpoint_t
+ */
+template <typename Endpoint>
+class awaitable_endpoint {
+public:
+    using endpoint_t = Endpoint;
+    using packet_id_t = typename Endpoint::packet_id_t;
+
+    /**
+     * @brief Received PUBLISH message
+     */
+    struct message {
+        optional<packet_id_t> packet_id;
+        publish_options pubopts;
+        buffer topic;
+        buffer contents;
+        v5::properties props;
+    };
+
+    /**
+     * @brief Constructor
+     * @param ep endpoint. The handlers listed in the class description are replaced.
+     */
+    explicit awaitable_endpoint(std::shared_ptr<Endpoint> ep)
+        :ep_(force_move(ep)) {
+        ep_->set_publish_handler(
+            [this]
+            (optional<packet_id_t> packet_id,
+             publish_options pubopts,
+             buffer topic,
+             buffer contents) {
+                on_publish(
+                    message { packet_id, pubopts, force_move(topic), force_move(contents), v5::properties{} }
+                );
+                return true;
+            }
+        );
+        ep_->set_v5_publish_handler(
+            [this]
+            (optional<packet_id_t> packet_id,
+             publish_options pubopts,
+             buffer topic,
+             buffer contents,
+             v5::properties props) {
+                on_publish(
+                    message { packet_id, pubopts, force_move(topic), force_move(contents), force_move(props) }
+                );
+                return true;
+            }
+        );
+        ep_->set_puback_handler(
+            [this]
+            (packet_id_t packet_id) {
+                complete(acks_, packet_id, error_code());
+                return true;
+            }
+        );
+        ep_->set_v5_puback_handler(
+            [this]
+            (packet_id_t packet_id, v5::puback_reason_code, v5::properties) {
+                complete(acks_, packet_id, error_code());
+                return true;
+            }
+        );
+        ep_->set_pubcomp_handler(
+            [this]
+            (packet_id_t packet_id) {
+                complete(acks_, packet_id, error_code());
+                return true;
+            }
+        );
+        ep_->set_v5_pubcomp_handler(
+            [this]
+            (packet_id_t packet_id, v5::pubcomp_reason_code, v5::properties) {
+                complete(acks_, packet_id, error_code());
+                return true;
+            }
+        );
+        ep_->set_suback_handler(
+            [this]
+            (packet_id_t packet_id, std::vector<suback_return_code> results) {
+                complete(subacks_, packet_id, error_code(), force_move(results));
+                return true;
+            }
+        );
+        ep_->set_v5_suback_handler(
+            [this]
+            (packet_id_t packet_id, std::vector<v5::suback_reason_code> reasons, v5::properties) {
+                complete(v5_subacks_, packet_id, error_code(), force_move(reasons));
+                return true;
+            }
+        );
+        ep_->set_unsuback_handler(
+            [this]
+            (packet_id_t packet_id) {
+                complete(acks_, packet_id, error_code());
+                return true;
+            }
+        );
+        ep_->set_v5_unsuback_handler(
+            [this]
+            (packet_id_t packet_id, std::vector<v5::unsuback_reason_code>, v5::properties) {
+                complete(acks_, packet_id, error_code());
+                return true;
+            }
+        );
+        ep_->set_close_handler(
+            [this] {
+                on_close(as::error::eof);
+            }
+        );
+        ep_->set_error_handler(
+            [this]
+            (error_code ec) {
+                on_close(ec);
+            }
+        );
+    }
+
+    awaitable_endpoint(awaitable_endpoint const&) = delete;
+    awaitable_endpoint(awaitable_endpoint&&) = delete;
+    awaitable_endpoint& operator=(awaitable_endpoint const&) = delete;
+    awaitable_endpoint& operator=(awaitable_endpoint&&) = delete;
+
+    /**
+     * @brief Destructor
+     *        The replaced handlers are cleared. Pending coroutines are destroyed.
+     */
+    ~awaitable_endpoint() {
+        ep_->set_publish_handler();
+        ep_->set_v5_publish_handler();
+        ep_->set_puback_handler();
+        ep_->set_v5_puback_handler();
+        ep_->set_pubcomp_handler();
+        ep_->set_v5_pubcomp_handler();
+        ep_->set_suback_handler();
+        ep_->set_v5_suback_handler();
+        ep_->set_unsuback_handler();
+        ep_->set_v5_unsuback_handler();
+        ep_->set_close_handler();
+        ep_->set_error_handler();
+    }
+
+    /**
+     * @brief Get the wrapped endpoint
+     * @return endpoint
+     */
+    Endpoint& endpoint() const {
+        return *ep_;
+    }
+
+    /**
+     * @brief Set the maximum number of received messages that are buffered until receive() is called.
+     *        When the limit is reached, the endpoint stops reading until receive() is called.
+     * @param limit maximum number of buffered messages. 0 means infinity (default).
+     */
+    void set_receive_limit(std::size_t limit) {
+        receive_limit_ = limit;
+    }
+
+    /**
+     * @brief Publish
+     *        The operation completes when the message is written (QoS0),
+     *        PUBACK is received (QoS1), or PUBCOMP is received (QoS2).
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param pubopts
+     *        qos, retain flag, and dup flag.
+     * @param props
+     *        Properties (v5 only)
+     * @return awaitable. It throws boost::system::system_error on failure.
+     */
+    as::awaitable<void> publish(
+        std::string topic_name,
+        std::string contents,
+        publish_options pubopts = {},
+        v5::properties props = {}
+    ) {
+        as::use_awaitable_t<> token;
+        return as::async_initiate<as::use_awaitable_t<>, void(error_code)>(
+            [
+                this,
+                topic_name = force_move(topic_name),
+                contents = force_move(contents),
+                pubopts,
+                props = force_move(props)
+            ]
+            (ack_handler_t handler) mutable {
+                if (pubopts.get_qos() == qos::at_most_once) {
+                    auto id = ++write_id_;
+                    writes_.emplace(id, force_move(handler));
+                    ep_->async_publish(
+                        0,
+                        force_move(topic_name),
+                        force_move(contents),
+                        pubopts,
+                        force_move(props),
+                        any{},
+                        [this, id]
+                        (error_code ec) {
+                            complete(writes_, id, ec);
+                        }
+                    );
+                    return;
+                }
+                auto packet_id = ep_->acquire_unique_packet_id_no_except();
+                if (!packet_id) {
+                    post_completion(force_move(handler), make_error_code(boost::system::errc::resource_unavailable_try_again));
+                    return;
+                }
+                acks_.emplace(packet_id.value(), force_move(handler));
+                ep_->async_publish(
+                    packet_id.value(),
+                    force_move(topic_name),
+                    force_move(contents),
+                    pubopts,
+                    force_move(props),
+                    any{},
+                    [this, pid = packet_id.value()]
+                    (error_code ec) {
+                        if (ec) complete(acks_, pid, ec);
+                    }
+                );
+            },
+            token
+        );
+    }
+
+    /**
+     * @brief Subscribe (MQTT v3.1.1)
+     *        The operation completes when SUBACK is received.
+     * @param entries
+     *        pairs of topic filter and subscribe options
+     * @return awaitable of the return codes in SUBACK. It throws boost::system::system_error on failure.
+     */
+    as::awaitable<std::vector<suback_return_code>> subscribe(
+        std::vector<std::tuple<std::string, subscribe_options>> entries
+    ) {
+        return async_subscribe_impl<suback_return_code>(subacks_, force_move(entries), v5::properties{});
+    }
+
+    /**
+     * @brief Subscribe a topic filter (MQTT v3.1.1)
+     * @param topic_filter
+     *        A topic filter to subscribe
+     * @param option
+     *        subscribe options
+     * @return awaitable of the return codes in SUBACK. It throws boost::system::system_error on failure.
+     */
+    as::awaitable<std::vector<suback_return_code>> subscribe(
+        std::string topic_filter,
+        subscribe_options option
+    ) {
+        return subscribe({ std::make_tuple(force_move(topic_filter), option) });
+    }
+
+    /**
+     * @brief Subscribe (MQTT v5)
+     *        The operation completes when SUBACK is received.
+     * @param entries
+     *        pairs of topic filter and subscribe options
+     * @param props
+     *        Properties
+     * @return awaitable of the reason codes in SUBACK. It throws boost::system::system_error on failure.
+     */
+    as::awaitable<std::vector<v5::suback_reason_code>> v5_subscribe(
+        std::vector<std::tuple<std::string, subscribe_options>> entries,
+        v5::properties props = {}
+    ) {
+        return async_subscribe_impl<v5::suback_reason_code>(v5_subacks_, force_move(entries), force_move(props));
+    }
+
+    /**
+     * @brief Unsubscribe
+     *        The operation completes when UNSUBACK is received.
+     * @param topic_filters
+     *        Topic filters to unsubscribe
+     * @param props
+     *        Properties (v5 only)
+     * @return awaitable. It throws boost::system::system_error on failure.
+     */
+    as::awaitable<void> unsubscribe(
+        std::vector<std::string> topic_filters,
+        v5::properties props = {}
+    ) {
+        as::use_awaitable_t<> token;
+        return as::async_initiate<as::use_awaitable_t<>, void(error_code)>(
+            [
+                this,
+                topic_filters = force_move(topic_filters),
+                props = force_move(props)
+            ]
+            (ack_handler_t handler) mutable {
+                auto packet_id = ep_->acquire_unique_packet_id_no_except();
+                if (!packet_id) {
+                    post_completion(force_move(handler), make_error_code(boost::system::errc::resource_unavailable_try_again));
+                    return;
+                }
+                acks_.emplace(packet_id.value(), force_move(handler));
+                ep_->async_unsubscribe(
+                    packet_id.value(),
+                    force_move(topic_filters),
+                    force_move(props),
+                    [this, pid = packet_id.value()]
+                    (error_code ec) {
+                        if (ec) complete(acks_, pid, ec);
+                    }
+                );
+            },
+            token
+        );
+    }
+
+    /**
+     * @brief Receive the next PUBLISH message
+     *        Messages that arrived before the call are buffered.
+     *        The response (PUBACK/PUBREC) is sent by the endpoint's auto_pub_response setting.
+     * @return awaitable of the message. It throws boost::system::system_error
+     *         when the endpoint is closed (boost::asio::error::eof on a normal close).
+     */
+    as::awaitable<message> receive() {
+        as::use_awaitable_t<> token;
+        return as::async_initiate<as::use_awaitable_t<>, void(error_code, message)>(
+            [this]
+            (receive_handler_t handler) {
+                if (!received_.empty()) {
+                    auto msg = force_move(received_.front());
+                    received_.pop_front();
+                    resume_read();
+                    post_completion(force_move(handler), error_code(), force_move(msg));
+                    return;
+                }
+                if (closed_) {
+                    post_completion(force_move(handler), closed_.value(), message());
+                    return;
+                }
+                receivers_.push_back(force_move(handler));
+            },
+            token
+        );
+    }
+
+private:
+    template <typename... Args>
+    using handler_t = typename as::async_result<as::use_awaitable_t<>, void(error_code, Args...)>::handler_type;
+    using ack_handler_t = handler_t<>;
+    using receive_handler_t = handler_t<message>;
+
+    template <typename Handler, typename... Args>
+    static void post_completion(Handler&& h, error_code ec, Args&&... args) {
+        // resume the coroutine on its own executor, not in the endpoint's handler
+        auto ex = h.get_executor();
+        as::post(
+            ex,
+            [h = force_move(h), ec, ...args = std::forward<Args>(args)]
+            () mutable {
+                h(ec, force_move(args)...);
+            }
+        );
+    }
+
+    template <typename Map, typename Key, typename... Args>
+    static void complete(Map& m, Key key, error_code ec, Args&&... args) {
+        auto it = m.find(key);
+        if (it == m.end()) return;
+        auto h = force_move(it->second);
+        m.erase(it);
+        post_completion(force_move(h), ec, std::forward<Args>(args)...);
+    }
+
+    template <typename Code, typename Map>
+    as::awaitable<std::vector<Code>> async_subscribe_impl(
+        Map& m,
+        std::vector<std::tuple<std::string, subscribe_options>> entries,
+        v5::properties props
+    ) {
+        as::use_awaitable_t<> token;
+        return as::async_initiate<as::use_awaitable_t<>, void(error_code, std::vector<Code>)>(
+            [
+                this,
+                &m,
+                entries = force_move(entries),
+                props = force_move(props)
+            ]
+            (handler_t<std::vector<Code>> handler) mutable {
+                auto packet_id = ep_->acquire_unique_packet_id_no_except();
+                if (!packet_id) {
+                    post_completion(
+                        force_move(handler),
+                        make_error_code(boost::system::errc::resource_unavailable_try_again),
+                        std::vector<Code>()
+                    );
+                    return;
+                }
+                m.emplace(packet_id.value(), force_move(handler));
+                ep_->async_subscribe(
+                    packet_id.value(),
+                    force_move(entries),
+                    force_move(props),
+                    [this, &m, pid = packet_id.value()]
+                    (error_code ec) {
+                        if (ec) complete(m, pid, ec, std::vector<Code>());
+                    }
+                );
+            },
+            token
+        );
+    }
+
+    void on_publish(message msg) {
+        if (!receivers_.empty()) {
+            auto h = force_move(receivers_.front());
+            receivers_.pop_front();
+            post_completion(force_move(h), error_code(), force_move(msg));
+            return;
+        }
+        received_.push_back(force_move(msg));
+        if (receive_limit_ != 0 && received_.size() >= receive_limit_ && !read_paused_) {
+            // stop reading after this message until receive() drains the buffer
+            read_paused_ = true;
+            ep_->set_auto_next_read(false);
+        }
+    }
+
+    void resume_read() {
+        if (!read_paused_ || received_.size() >= receive_limit_ || closed_) return;
+        read_paused_ = false;
+        ep_->set_auto_next_read(true);
+        ep_->async_read_next_message(ep_);
+    }
+
+    void on_close(error_code ec) {
+        closed_.emplace(ec);
+        auto fail_all =
+            [&](auto& m, auto&&... args) {
+                auto pending = force_move(m);
+                m.clear();
+                for (auto& e : pending) post_completion(force_move(e.second), ec, args...);
+            };
+        fail_all(writes_);
+        fail_all(acks_);
+        fail_all(subacks_, std::vector<suback_return_code>());
+        fail_all(v5_subacks_, std::vector<v5::suback_reason_code>());
+        auto receivers = force_move(receivers_);
+        receivers_.clear();
+        for (auto& h : receivers) post_completion(force_move(h), ec, message());
+    }
+
+private:
+    std::shared_ptr<Endpoint> ep_;
+    std::uint64_t write_id_ = 0;
+    std::map<std::uint64_t, ack_handler_t> writes_;
+    std::map<packet_id_t, ack_handler_t> acks_;
+    std::map<packet_id_t, handler_t<std::vector<suback_return_code>>> subacks_;
+    std::map<packet_id_t, handler_t<std::vector<v5::suback_reason_code>>> v5_subacks_;
+    std::deque<receive_handler_t> receivers_;
+    std::deque<message> received_;
+    std::size_t receive_limit_ = 0;
+    bool read_paused_ = false;
+    optional<error_code> closed_;
+};
+
+} // namespace MQTT_NS
+
+#endif // defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+#endif // MQTT_AWAITABLE_HPP
@@ -10,6 +10,7 @@
 #include <mqtt/config.hpp>
 
 #include <set>
+#include <map>
 
 #include <boost/lexical_cast.hpp>
 
@@ -24,6 +25,8 @@
 
 #include <mqtt/broker/retained_topic_map.hpp>
 #include <mqtt/broker/shared_target_impl.hpp>
+#include <mqtt/broker/broker_counters.hpp>
+#include <mqtt/broker/publisher_credit.hpp>
 
 MQTT_BROKER_NS_BEGIN
 
@@ -257,7 +260,8 @@ class broker_t {
 public:
     broker_t(as::io_context& ioc)
         :ioc_(ioc),
-         tim_disconnect_(ioc_)
+         tim_disconnect_(ioc_),
+         tim_sys_(ioc_)
     {}
 
     // [begin] for test setting
@@ -307,6 +311,7 @@ public:
 
         ep.socket().lowest_layer().set_option(as::ip::tcp::no_delay(true));
         ep.set_auto_pub_response(false);
+        counters_.endpoints()->add(ep.get_counters());
         // Pass spep to keep lifetime.
         // It makes sure wp.lock() never return nullptr in the handlers below
         // including close_handler and error_handler.
@@ -705,6 +710,57 @@ public:
 
     void clear_all_retained_topics() {
         retains_.clear();
+        counters_.retained_cleared();
+    }
+
+    /**
+     * @brief Get broker-wide performance counters.
+     *
+     * The counters can be read from any thread.
+     * Call get_counters().get_snapshot() to get a copy of all counters.
+     * @return broker counters
+     */
+    broker_counters const& get_counters() const {
+        return counters_;
+    }
+
+    /**
+     * @brief Set the watermarks of the publisher read backpressure.
+     *
+     * A message that cannot be sent to an online subscriber immediately
+     * (e.g. the Receive Maximum of the subscriber is reached) is queued in the broker.
+     * If the queued bytes on behalf of a publisher exceed high_watermark, the broker
+     * stops reading from the publisher until they fall to low_watermark.
+     * Then TCP flow control pushes back the publisher.
+     * Call this function before accepting connections.
+     *
+     * @param high_watermark - 0 (default) disables the backpressure.
+     * @param low_watermark - must be less than or equal to high_watermark.
+     */
+    void set_publisher_backpressure(std::size_t high_watermark, std::size_t low_watermark) {
+        BOOST_ASSERT(low_watermark <= high_watermark);
+        publisher_credit_high_watermark_ = high_watermark;
+        publisher_credit_low_watermark_ = low_watermark;
+    }
+
+    /**
+     * @brief Set the interval of $SYS topic publishing.
+     *
+     * Broker statistics are published as retained QoS0 messages whose topic names
+     * start with "$SYS/broker/". Only changed values are published.
+     * The statistics are not delivered to subscriptions that start with a wildcard
+     * (e.g. "#" and "+/broker/uptime"). Subscribe "$SYS/#" to receive all of them.
+     * Call this function on the broker's io_context.
+     *
+     * @param interval - publish interval. zero (default) stops publishing.
+     */
+    void set_sys_interval(std::chrono::steady_clock::duration interval) {
+        sys_interval_ = interval;
+        tim_sys_.cancel();
+        if (sys_interval_ == std::chrono::steady_clock::duration::zero()) return;
+        sys_prev_ = counters_.get_snapshot();
+        sys_prev_time_ = std::chrono::steady_clock::now();
+        start_sys_timer();
     }
 
 private:
@@ -739,6 +795,7 @@ private:
 
         optional<std::chrono::steady_clock::duration> session_expiry_interval;
         optional<std::chrono::steady_clock::duration> will_expiry_interval;
+        std::size_t receive_maximum = receive_maximum_max;
 
         if (ep.get_protocol_version() == protocol_version::v5) {
             auto v = get_property<v5::property::session_expiry_interval>(props);
@@ -746,6 +803,11 @@ private:
                 session_expiry_interval.emplace(std::chrono::seconds(v.value().val()));
             }
 
+            // Receive Maximum 0 is a protocol error. Treat it as absent.
+            if (auto rm = get_property<v5::property::receive_maximum>(props)) {
+                if (rm.value().val() != 0) receive_maximum = rm.value().val();
+            }
+
             if (will) {
                 auto v = get_property<v5::property::message_expiry_interval>(will.value().props());
                 if (v) {
@@ -822,6 +884,7 @@ private:
             it = idx.emplace_hint(
                 it,
                 ioc_,
+                counters_,
                 subs_map_,
                 shared_targets_,
                 spep,
@@ -830,6 +893,7 @@ private:
                 force_move(will_expiry_interval),
                 force_move(session_expiry_interval)
             );
+            idx.modify(it, [&](auto& e) { e.set_publish_send_max(receive_maximum); });
 
             send_connack(false);
         }
@@ -848,6 +912,7 @@ private:
                         it,
                         [&](auto& e) {
                             e.clean();
+                            e.set_publish_send_max(receive_maximum);
                             e.update_will(ioc_, force_move(will), will_expiry_interval);
                             // TODO: e.will_delay = force_move(will_delay);
                             e.renew_session_expiry(force_move(session_expiry_interval));
@@ -866,6 +931,7 @@ private:
                         it,
                         [&](auto& e) {
                             e.reset_con(spep);
+                            e.set_publish_send_max(receive_maximum);
                             e.restore_topic_alias_recv();
                             e.update_will(ioc_, force_move(will), will_expiry_interval);
                             // TODO: e.will_delay = force_move(will_delay);
@@ -887,6 +953,7 @@ private:
                 bool inserted;
                 std::tie(it, inserted) = idx.emplace(
                     ioc_,
+                    counters_,
                     subs_map_,
                     shared_targets_,
                     spep,
@@ -896,6 +963,7 @@ private:
                     force_move(session_expiry_interval)
                 );
                 BOOST_ASSERT(inserted);
+                idx.modify(it, [&](auto& e) { e.set_publish_send_max(receive_maximum); });
                 send_connack(false);
             }
         }
@@ -913,6 +981,7 @@ private:
                     [&](auto& e) {
                         e.clean();
                         e.reset_con(spep);
+                        e.set_publish_send_max(receive_maximum);
                         e.update_will(ioc_, force_move(will), will_expiry_interval);
                         // TODO: e.will_delay = force_move(will_delay);
                         e.renew_session_expiry(force_move(session_expiry_interval));
@@ -931,6 +1000,7 @@ private:
                     it,
                     [&](auto& e) {
                         e.reset_con(spep);
+                        e.set_publish_send_max(receive_maximum);
                         e.restore_topic_alias_recv();
                         e.update_will(ioc_, force_move(will), will_expiry_interval);
                         // TODO: e.will_delay = force_move(will_delay);
@@ -1011,7 +1081,7 @@ private:
                         }
 
                         do_publish(
-                            ep,
+                            &ep,
                             force_move(session.will().value().topic()),
                             force_move(session.will().value().message()),
                             session.will().value().get_qos() | session.will().value().get_retain(),
@@ -1127,12 +1197,26 @@ private:
             );
         }
 
+        std::shared_ptr<publisher_credit> credit;
+        if (publisher_credit_high_watermark_ != 0) {
+            if (!it->credit()) {
+                idx.modify(
+                    it,
+                    [&](auto& e) {
+                        e.set_credit(make_publisher_credit(spep));
+                    }
+                );
+            }
+            credit = it->credit();
+        }
+
         do_publish(
-            ep,
+            &ep,
             force_move(topic_name),
             force_move(contents),
             pubopts.get_qos() | pubopts.get_retain(), // remove dup flag
-            force_move(forward_props)
+            force_move(forward_props),
+            credit
         );
 
         switch (ep.get_protocol_version()) {
@@ -1165,9 +1249,42 @@ private:
             break;
         }
 
+        if (credit && credit->exceeded() && !credit->paused()) {
+            // Stop reading from the publisher after this message.
+            // TCP flow control pushes back the publisher.
+            MQTT_LOG("mqtt_broker", trace)
+                << MQTT_ADD_VALUE(address, spep.get())
+                << "pause reading queued bytes:" << credit->bytes();
+            credit->pause();
+            ep.set_auto_next_read(false);
+        }
+
         return true;
     }
 
+    std::shared_ptr<publisher_credit> make_publisher_credit(con_sp_t const& spep) {
+        return std::make_shared<publisher_credit>(
+            publisher_credit_high_watermark_,
+            publisher_credit_low_watermark_,
+            [this, wp = con_wp_t(spep)] {
+                // The charge could be released during the subscriber side processing.
+                // Resume reading after that.
+                as::post(
+                    ioc_,
+                    [wp] {
+                        if (auto sp = wp.lock()) {
+                            MQTT_LOG("mqtt_broker", trace)
+                                << MQTT_ADD_VALUE(address, sp.get())
+                                << "resume reading";
+                            sp->set_auto_next_read(true);
+                            sp->async_read_next_message(sp);
+                        }
+                    }
+                );
+            }
+        );
+    }
+
     bool puback_handler(
         con_sp_t spep,
         packet_id_t packet_id,
@@ -1180,6 +1297,7 @@ private:
             it,
             [&](auto& e) {
                 e.erase_inflight_message_by_packet_id(packet_id);
+                e.publish_send_finished();
                 e.send_offline_messages_by_packet_id_release();
             }
         );
@@ -1260,6 +1378,7 @@ private:
             it,
             [&](auto& e) {
                 e.erase_inflight_message_by_packet_id(packet_id);
+                e.publish_send_finished();
                 e.send_offline_messages_by_packet_id_release();
             }
         );
@@ -1464,7 +1583,7 @@ private:
     /**
      * @brief do_publish Publish a message to any subscribed clients.
      *
-     * @param ep - endpoint.
+     * @param ep - endpoint of the publisher. nullptr if the broker itself publishes.
      * @param topic - The topic to publish the message on.
      * @param contents - The contents of the message.
      * @param qos - The QOS setting to use for the published message.
@@ -1472,11 +1591,12 @@ private:
      *                    be sent to newly added subscriptions in the future.\
      */
     void do_publish(
-        endpoint_t& ep,
+        endpoint_t const* ep,
         buffer topic,
         buffer contents,
         publish_options pubopts,
-        v5::properties props) {
+        v5::properties props,
+        std::shared_ptr<publisher_credit> const& credit = nullptr) {
 
         // publish the message to subscribers.
         // retain is delivered as the original only if rap_value is rap::retain.
@@ -1495,7 +1615,8 @@ private:
                         topic,
                         contents,
                         new_pubopts,
-                        props
+                        props,
+                        credit
                     );
                     props.pop_back();
                 }
@@ -1505,7 +1626,8 @@ private:
                         topic,
                         contents,
                         new_pubopts,
-                        props
+                        props,
+                        credit
                     );
                 }
             };
@@ -1521,8 +1643,9 @@ private:
 
                     // If NL (no local) subscription option is set and
                     // publisher is the same as subscriber, then skip it.
-                    if (sub.subopts.get_nl() == nl::yes &&
-                        sub.ss.get().con().get() ==  &ep) return;
+                    if (ep &&
+                        sub.subopts.get_nl() == nl::yes &&
+                        sub.ss.get().con().get() == ep) return;
                     deliver(sub.ss.get(), sub);
                 }
                 else {
@@ -1539,7 +1662,7 @@ private:
         );
 
         optional<std::chrono::steady_clock::duration> message_expiry_interval;
-        if (ep.get_protocol_version() == protocol_version::v5) {
+        if (!ep || ep->get_protocol_version() == protocol_version::v5) {
             auto v = get_property<v5::property::message_expiry_interval>(props);
             if (v) {
                 message_expiry_interval.emplace(std::chrono::seconds(v.value().val()));
@@ -1570,7 +1693,7 @@ private:
          */
         if (pubopts.get_retain() == MQTT_NS::retain::yes) {
             if (contents.empty()) {
-                retains_.erase(topic);
+                erase_retain(topic);
             }
             else {
                 std::shared_ptr<as::steady_timer> tim_message_expiry;
@@ -1581,14 +1704,15 @@ private:
                         (boost::system::error_code const& ec) {
                             if (auto sp = wp.lock()) {
                                 if (!ec) {
-                                    retains_.erase(topic);
+                                    erase_retain(topic);
                                 }
                             }
                         }
                     );
                 }
 
-                retains_.insert_or_assign(
+                auto bytes = retained_size(topic, contents);
+                auto inserted = retains_.insert_or_assign(
                     topic,
                     retain_t {
                         force_move(topic),
@@ -1596,17 +1720,133 @@ private:
                         force_move(props),
                         pubopts.get_qos(),
                         tim_message_expiry
+                    },
+                    [&](retain_t const& prev) {
+                        counters_.retained_replaced(retained_size(prev.topic, prev.contents), bytes);
                     }
                 );
+                if (inserted) {
+                    counters_.retained_inserted(bytes);
+                }
             }
         }
     }
 
+    static std::size_t retained_size(buffer const& topic, buffer const& contents) {
+        return topic.size() + contents.size();
+    }
+
+    void erase_retain(buffer const& topic) {
+        retains_.erase(
+            topic,
+            [&](retain_t const& r) {
+                counters_.retained_erased(retained_size(r.topic, r.contents));
+            }
+        );
+    }
+
+    void start_sys_timer() {
+        if (sys_interval_ == std::chrono::steady_clock::duration::zero()) return;
+        tim_sys_.expires_after(sys_interval_);
+        tim_sys_.async_wait(
+            [this]
+            (error_code ec) {
+                if (ec) return;
+                publish_sys();
+                start_sys_timer();
+            }
+        );
+    }
+
+    /**
+     * @brief publish_sys Publish broker statistics on $SYS topics.
+     *
+     * Load values are per second averages since the previous call.
+     */
+    void publish_sys() {
+        auto now = std::chrono::steady_clock::now();
+        auto s = counters_.get_snapshot();
+        auto sec = std::chrono::duration<double>(now - sys_prev_time_).count();
+        auto per_sec =
+            [&] (std::size_t cur, std::size_t prev) -> std::size_t {
+                if (sec <= 0 || cur < prev) return 0;
+                return static_cast<std::size_t>(static_cast<double>(cur - prev) / sec + 0.5);
+            };
+        auto msgs_received = s.endpoints.received(control_packet_type::publish);
+        auto msgs_sent = s.endpoints.sent(control_packet_type::publish);
+
+        publish_sys_value("uptime", std::chrono::duration_cast<std::chrono::seconds>(now - start_time_).count());
+        publish_sys_value("clients/connected", s.sessions_online);
+        publish_sys_value("clients/disconnected", s.sessions_offline);
+        publish_sys_value("clients/total", s.sessions_online + s.sessions_offline);
+        publish_sys_value("subscriptions/count", s.subscriptions);
+        publish_sys_value("retained/count", s.retained_messages);
+        publish_sys_value("retained/bytes", s.retained_bytes);
+        publish_sys_value("messages/inflight", s.endpoints.store_size);
+        publish_sys_value("messages/offline", s.offline_messages);
+        publish_sys_value("messages/dropped", s.messages_expired + s.messages_discarded);
+        publish_sys_value("messages/received", msgs_received);
+        publish_sys_value("messages/sent", msgs_sent);
+        publish_sys_value("bytes/received", s.endpoints.bytes_received);
+        publish_sys_value("bytes/sent", s.endpoints.bytes_sent);
+        publish_sys_value(
+            "load/messages/received",
+            per_sec(msgs_received, sys_prev_.endpoints.received(control_packet_type::publish))
+        );
+        publish_sys_value(
+            "load/messages/sent",
+            per_sec(msgs_sent, sys_prev_.endpoints.sent(control_packet_type::publish))
+        );
+        publish_sys_value("load/bytes/received", per_sec(s.endpoints.bytes_received, sys_prev_.endpoints.bytes_received));
+        publish_sys_value("load/bytes/sent", per_sec(s.endpoints.bytes_sent, sys_prev_.endpoints.bytes_sent));
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        publish_sys_latency("receive", s.endpoints.receive_latency);
+        publish_sys_latency("process", s.endpoints.process_latency);
+        publish_sys_latency("send", s.endpoints.send_latency);
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+
+        sys_prev_ = force_move(s);
+        sys_prev_time_ = now;
+    }
+
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+    // Publish percentiles in nanoseconds since the broker started
+    void publish_sys_latency(std::string const& stage, latency_histogram::snapshot const& h) {
+        publish_sys_value("latency/" + stage + "/p50", h.percentile(50));
+        publish_sys_value("latency/" + stage + "/p99", h.percentile(99));
+        publish_sys_value("latency/" + stage + "/max", h.max);
+    }
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+
+    template <typename T>
+    void publish_sys_value(std::string const& name, T const& value) {
+        auto contents = boost::lexical_cast<std::string>(value);
+        auto ret = sys_values_.emplace(name, contents);
+        if (!ret.second) {
+            if (ret.first->second == contents) return;
+            ret.first->second = contents;
+        }
+        do_publish(
+            nullptr,
+            allocate_buffer("$SYS/broker/" + name),
+            allocate_buffer(contents),
+            qos::at_most_once | MQTT_NS::retain::yes,
+            v5::properties{}
+        );
+    }
+
 private:
     as::io_context& ioc_; ///< The boost asio context to run this broker on.
     as::steady_timer tim_disconnect_; ///< Used to delay disconnect handling for testing
     optional<std::chrono::steady_clock::duration> delay_disconnect_; ///< Used to delay disconnect handling for testing
-
+    as::steady_timer tim_sys_; ///< $SYS topic publish timer
+    std::chrono::steady_clock::duration sys_interval_{}; ///< $SYS topic publish interval
+    std::chrono::steady_clock::time_point start_time_ = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point sys_prev_time_;
+    broker_counters::snapshot sys_prev_;
+    std::map<std::string, std::string> sys_values_; ///< last published $SYS values
+
+    broker_counters counters_; ///< performance counters. session_state has a reference of it.
     sub_con_map subs_map_;   /// subscription information
     shared_target shared_targets_; /// shared subscription targets
 
@@ -1637,6 +1877,8 @@ private:
     std::function<void(v5::properties const&)> h_unsubscribe_props_;
     std::function<void(v5::properties const&)> h_auth_props_;
     bool pingresp_ = true;
+    std::size_t publisher_credit_high_watermark_ = 0; ///< 0 means publisher backpressure is disabled
+    std::size_t publisher_credit_low_watermark_ = 0;
 };
 
 MQTT_BROKER_NS_END
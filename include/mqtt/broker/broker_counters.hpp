@@ -0,0 +1,175 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_BROKER_BROKER_COUNTERS_HPP)
+#define MQTT_BROKER_BROKER_COUNTERS_HPP
+
+#include <mqtt/config.hpp>
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+
+#include <mqtt/endpoint_counters.hpp>
+
+#include <mqtt/broker/broker_namespace.hpp>
+
+MQTT_BROKER_NS_BEGIN
+
+/**
+ * @brief Lock-free broker-wide performance counters.
+ *
+ * The counters are updated by the broker on its io_context and can be read
+ * from any thread. endpoints() aggregates the endpoint_counters of all
+ * accepted connections (packets, bytes, send queues, and stores) on read.
+ */
+class broker_counters {
+public:
+    using value_type = std::size_t;
+
+    /**
+     * @brief Plain copy of the counters.
+     */
+    struct snapshot {
+        value_type sessions_online = 0;
+        value_type sessions_offline = 0;
+        value_type subscriptions = 0;
+        value_type retained_messages = 0;
+        value_type retained_bytes = 0;
+        value_type offline_messages = 0;
+        value_type messages_expired = 0;
+        value_type messages_discarded = 0;
+        endpoint_counters::snapshot endpoints;
+    };
+
+    broker_counters()
+        :endpoints_(std::make_shared<endpoint_counters_group>())
+    {}
+    broker_counters(broker_counters const&) = delete;
+    broker_counters& operator=(broker_counters const&) = delete;
+
+    /**
+     * @brief Get the group of all connection's endpoint_counters.
+     * @return endpoint counters group
+     */
+    std::shared_ptr<endpoint_counters_group> const& endpoints() const {
+        return endpoints_;
+    }
+
+    void session_created(bool online) {
+        add(online ? sessions_online_ : sessions_offline_, 1);
+    }
+    void session_destroyed(bool online) {
+        sub(online ? sessions_online_ : sessions_offline_, 1);
+    }
+    void session_became_online() {
+        sub(sessions_offline_, 1);
+        add(sessions_online_, 1);
+    }
+    void session_became_offline() {
+        sub(sessions_online_, 1);
+        add(sessions_offline_, 1);
+    }
+
+    void set_subscriptions(value_type size) {
+        subscriptions_.store(size, std::memory_order_relaxed);
+    }
+
+    void retained_inserted(value_type bytes) {
+        add(retained_messages_, 1);
+        add(retained_bytes_, bytes);
+    }
+    void retained_erased(value_type bytes) {
+        sub(retained_messages_, 1);
+        sub(retained_bytes_, bytes);
+    }
+    void retained_replaced(value_type prev_bytes, value_type bytes) {
+        add(retained_bytes_, bytes);
+        sub(retained_bytes_, prev_bytes);
+    }
+    void retained_cleared() {
+        retained_messages_.store(0, std::memory_order_relaxed);
+        retained_bytes_.store(0, std::memory_order_relaxed);
+    }
+
+    void offline_message_pushed() {
+        add(offline_messages_, 1);
+    }
+    void offline_messages_popped(value_type num) {
+        sub(offline_messages_, num);
+    }
+
+    /**
+     * @brief Record messages dropped because their message expiry interval is elapsed.
+     * @param num number of messages
+     */
+    void messages_expired(value_type num) {
+        add(messages_expired_, num);
+    }
+
+    /**
+     * @brief Record messages dropped together with their session (clean start or session expiry).
+     * @param num number of messages
+     */
+    void messages_discarded(value_type num) {
+        add(messages_discarded_, num);
+    }
+
+    value_type sessions_online() const { return load(sessions_online_); }
+    value_type sessions_offline() const { return load(sessions_offline_); }
+    value_type subscriptions() const { return load(subscriptions_); }
+    value_type retained_messages() const { return load(retained_messages_); }
+    value_type retained_bytes() const { return load(retained_bytes_); }
+    value_type offline_messages() const { return load(offline_messages_); }
+    value_type messages_expired() const { return load(messages_expired_); }
+    value_type messages_discarded() const { return load(messages_discarded_); }
+
+    /**
+     * @brief Get a copy of all counters.
+     *        Each value is read atomically, the set of values is not a consistent cut.
+     * @return snapshot
+     */
+    snapshot get_snapshot() const {
+        snapshot s;
+        s.sessions_online = load(sessions_online_);
+        s.sessions_offline = load(sessions_offline_);
+        s.subscriptions = load(subscriptions_);
+        s.retained_messages = load(retained_messages_);
+        s.retained_bytes = load(retained_bytes_);
+        s.offline_messages = load(offline_messages_);
+        s.messages_expired = load(messages_expired_);
+        s.messages_discarded = load(messages_discarded_);
+        s.endpoints = endpoints_->get_snapshot();
+        return s;
+    }
+
+private:
+    using counter_t = std::atomic<value_type>;
+
+    static void add(counter_t& c, value_type v) {
+        c.fetch_add(v, std::memory_order_relaxed);
+    }
+    static void sub(counter_t& c, value_type v) {
+        c.fetch_sub(v, std::memory_order_relaxed);
+    }
+    static value_type load(counter_t const& c) {
+        return c.load(std::memory_order_relaxed);
+    }
+
+    counter_t sessions_online_{0};
+    counter_t sessions_offline_{0};
+    counter_t subscriptions_{0};
+    counter_t retained_messages_{0};
+    counter_t retained_bytes_{0};
+    counter_t offline_messages_{0};
+    counter_t messages_expired_{0};
+    counter_t messages_discarded_{0};
+    std::shared_ptr<endpoint_counters_group> endpoints_;
+};
+
+MQTT_BROKER_NS_END
+
+#endif // MQTT_BROKER_BROKER_COUNTERS_HPP
@@ -115,6 +115,10 @@ public:
         messages_.clear();
     }
 
+    std::size_t size() const {
+        return messages_.size();
+    }
+
     template <typename Tag>
     decltype(auto) get() {
         return messages_.get<Tag>();
@@ -23,6 +23,7 @@
 #include <mqtt/broker/common_type.hpp>
 #include <mqtt/broker/tags.hpp>
 #include <mqtt/broker/property_util.hpp>
+#include <mqtt/broker/broker_counters.hpp>
 
 MQTT_BROKER_NS_BEGIN
 
@@ -41,12 +42,14 @@ public:
         buffer contents,
         publish_options pubopts,
         v5::properties props,
-        std::shared_ptr<as::steady_timer> tim_message_expiry)
+        std::shared_ptr<as::steady_timer> tim_message_expiry,
+        std::shared_ptr<void> credit_charge = nullptr)
         : topic_(force_move(topic)),
           contents_(force_move(contents)),
           pubopts_(pubopts),
           props_(force_move(props)),
-          tim_message_expiry_(force_move(tim_message_expiry))
+          tim_message_expiry_(force_move(tim_message_expiry)),
+          credit_charge_(force_move(credit_charge))
     { }
 
     bool send(endpoint_t& ep) const {
@@ -87,15 +90,34 @@ private:
     publish_options pubopts_;
     v5::properties props_;
     std::shared_ptr<as::steady_timer> tim_message_expiry_;
+    // charge of publisher_credit. it is not a part of the key.
+    mutable std::shared_ptr<void> credit_charge_;
 };
 
 class offline_messages {
 public:
-    void send_all(endpoint_t& ep) {
+    offline_messages(broker_counters& counters)
+        :counters_(counters)
+    {}
+
+    /**
+     * @brief Send messages in order until a message cannot be sent.
+     * @param ep       endpoint to send
+     * @param inflight the number of QoS1 and QoS2 messages in flight.
+     *                 It is incremented when a QoS1 or QoS2 message is sent.
+     * @param max      the maximum number of QoS1 and QoS2 messages in flight
+     */
+    void send_all(endpoint_t& ep, std::size_t& inflight, std::size_t max) {
         auto& idx = messages_.get<tag_seq>();
         while (!idx.empty()) {
-            if (idx.front().send(ep)) {
+            auto const& m = idx.front();
+            bool qos0 = m.pubopts_.get_qos() == qos::at_most_once;
+            // keep the order, subsequent QoS0 messages wait as well
+            if (!qos0 && inflight >= max) break;
+            if (m.send(ep)) {
+                if (!qos0) ++inflight;
                 idx.pop_front();
+                counters_.offline_messages_popped(1);
             }
             else {
                 break;
@@ -103,20 +125,14 @@ public:
         }
     }
 
-    void send_by_packet_id_release(endpoint_t& ep) {
-        auto& idx = messages_.get<tag_seq>();
-        while (!idx.empty()) {
-            if (idx.front().send(ep)) {
-                // if packet_id is consumed, then finish
-                idx.pop_front();
-            }
-            else {
-                break;
-            }
-        }
+    void send_by_packet_id_release(endpoint_t& ep, std::size_t& inflight, std::size_t max) {
+        // if packet_id or inflight window is consumed, then finish
+        send_all(ep, inflight, max);
     }
 
     void clear() {
+        counters_.offline_messages_popped(messages_.size());
+        counters_.messages_discarded(messages_.size());
         messages_.clear();
     }
 
@@ -124,12 +140,24 @@ public:
         return messages_.empty();
     }
 
+    /**
+     * @brief Release the publisher credit charges of all messages.
+     *        Call it when the subscriber becomes offline, then the publishers
+     *        don't wait for the subscriber's reconnection.
+     */
+    void release_credit_charges() {
+        for (auto const& m : messages_) {
+            m.credit_charge_.reset();
+        }
+    }
+
     void push_back(
         as::io_context& ioc,
         buffer pub_topic,
         buffer contents,
         publish_options pubopts,
-        v5::properties props) {
+        v5::properties props,
+        std::shared_ptr<void> credit_charge = nullptr) {
         optional<std::chrono::steady_clock::duration> message_expiry_interval;
 
         auto v = get_property<v5::property::message_expiry_interval>(props);
@@ -144,7 +172,9 @@ public:
                 [this, wp = std::weak_ptr<as::steady_timer>(tim_message_expiry)](error_code ec) mutable {
                     if (auto sp = wp.lock()) {
                         if (!ec) {
-                            messages_.get<tag_tim>().erase(sp);
+                            auto num = messages_.get<tag_tim>().erase(sp);
+                            counters_.offline_messages_popped(num);
+                            counters_.messages_expired(num);
                         }
                     }
                 }
@@ -157,8 +187,10 @@ public:
             force_move(contents),
             pubopts,
             force_move(props),
-            force_move(tim_message_expiry)
+            force_move(tim_message_expiry),
+            force_move(credit_charge)
         );
+        counters_.offline_message_pushed();
     }
 
 private:
@@ -175,6 +207,7 @@ private:
         >
     >;
 
+    broker_counters& counters_;
     mi_offline_message messages_;
 };
 
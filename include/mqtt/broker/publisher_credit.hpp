@@ -0,0 +1,97 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_BROKER_PUBLISHER_CREDIT_HPP)
+#define MQTT_BROKER_PUBLISHER_CREDIT_HPP
+
+#include <mqtt/config.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <functional>
+
+#include <mqtt/move.hpp>
+
+#include <mqtt/broker/broker_namespace.hpp>
+
+MQTT_BROKER_NS_BEGIN
+
+/**
+ * @brief Outbound bytes queued in the broker on behalf of a publisher.
+ *
+ * A message that cannot be sent to an online subscriber immediately is queued
+ * with a charge of its size. The charge is released when the queued message is
+ * sent or dropped. The broker stops reading from the publisher while the charged
+ * bytes exceed the high watermark, and resumes when they fall to the low watermark.
+ */
+class publisher_credit : public std::enable_shared_from_this<publisher_credit> {
+public:
+    using resume_handler = std::function<void()>;
+
+    publisher_credit(std::size_t high_watermark, std::size_t low_watermark, resume_handler h)
+        :high_watermark_(high_watermark),
+         low_watermark_(low_watermark),
+         h_(force_move(h))
+    {}
+
+    /**
+     * @brief Charge bytes.
+     * @param bytes size of the queued message
+     * @return charge. The bytes are released when the charge is destroyed.
+     */
+    std::shared_ptr<void> charge(std::size_t bytes) {
+        bytes_ += bytes;
+        return std::shared_ptr<void>(
+            nullptr,
+            [self = this->shared_from_this(), bytes](void*) {
+                self->release(bytes);
+            }
+        );
+    }
+
+    /**
+     * @brief Check whether the charged bytes exceed the high watermark.
+     * @return true if exceeded
+     */
+    bool exceeded() const {
+        return bytes_ > high_watermark_;
+    }
+
+    /**
+     * @brief Mark that reading from the publisher is paused.
+     *        The resume handler is called when the charged bytes fall to the low watermark.
+     */
+    void pause() {
+        paused_ = true;
+    }
+
+    bool paused() const {
+        return paused_;
+    }
+
+    std::size_t bytes() const {
+        return bytes_;
+    }
+
+private:
+    void release(std::size_t bytes) {
+        bytes_ -= bytes;
+        if (paused_ && bytes_ <= low_watermark_) {
+            paused_ = false;
+            if (h_) h_();
+        }
+    }
+
+    std::size_t high_watermark_;
+    std::size_t low_watermark_;
+    resume_handler h_;
+    std::size_t bytes_ = 0;
+    bool paused_ = false;
+};
+
+MQTT_BROKER_NS_END
+
+#endif // MQTT_BROKER_PUBLISHER_CREDIT_HPP
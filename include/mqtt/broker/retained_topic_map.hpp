@@ -210,12 +210,11 @@ class retained_topic_map {
 
                     if (t == string_view("+")) {
                         for (auto i = wildcard_index.lower_bound(parent); i != wildcard_index.end() && i->parent_id == parent; ++i) {
+                            // Topics starting with '$' are not matched by a wildcard on the first level.
+                            // The entries are not ordered by name, so skip it and continue.
                             if (parent != root_node_id || i->name.empty() || i->name[0] != '$') {
                                 new_entries.push_back(map.template project<direct_index_tag, wildcard_const_iterator>(i));
                             }
-                            else {
-                                break;
-                            }
                         }
                     }
                     else if (t == string_view("#")) {
@@ -243,11 +242,13 @@ class retained_topic_map {
     }
 
     // Remove a value at the specified topic
-    size_t erase_topic(string_view topic) {
+    template<typename Erased>
+    size_t erase_topic(string_view topic, Erased&& erased) {
         auto path = find_topic(topic);
 
         // Reset the value if there is actually something stored
         if (!path.empty() && path.back()->value) {
+            std::forward<Erased>(erased)(*path.back()->value);
             auto& direct_index = map.template get<direct_index_tag>();
             direct_index.modify(path.back(), [](path_entry &entry){ entry.value = nullopt; });
 
@@ -306,6 +307,12 @@ public:
     // Insert a value at the specified topic
     template<typename V>
     std::size_t insert_or_assign(string_view topic, V&& value) {
+        return insert_or_assign(topic, std::forward<V>(value), [](Value const&) {});
+    }
+
+    // Insert a value at the specified topic, replaced is called with the previous value if exists
+    template<typename V, typename Replaced>
+    std::size_t insert_or_assign(string_view topic, V&& value, Replaced&& replaced) {
         auto& direct_index = map.template get<direct_index_tag>();
         auto path = this->find_topic(topic);
 
@@ -323,6 +330,7 @@ public:
             return 1;
         }
 
+        std::forward<Replaced>(replaced)(*path.back()->value);
         direct_index.modify(path.back(), [&value](path_entry &entry) mutable { entry.value.emplace(std::forward<V>(value)); });
 
         return 0;
@@ -336,7 +344,13 @@ public:
 
     // Remove a stored value at the specified topic
     std::size_t erase(string_view topic) {
-        auto result = erase_topic(topic);
+        return erase(topic, [](Value const&) {});
+    }
+
+    // Remove a stored value at the specified topic, erased is called with the value before removal
+    template<typename Erased>
+    std::size_t erase(string_view topic, Erased&& erased) {
+        auto result = erase_topic(topic, std::forward<Erased>(erased));
         decrease_map_size(result);
         return result;
     }
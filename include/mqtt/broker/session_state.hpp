@@ -16,6 +16,8 @@
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/member.hpp>
 
+#include <mqtt/constant.hpp>
+
 #include <mqtt/broker/broker_namespace.hpp>
 
 #include <mqtt/broker/common_type.hpp>
@@ -25,6 +27,8 @@
 #include <mqtt/broker/tags.hpp>
 #include <mqtt/broker/inflight_message.hpp>
 #include <mqtt/broker/offline_message.hpp>
+#include <mqtt/broker/broker_counters.hpp>
+#include <mqtt/broker/publisher_credit.hpp>
 
 MQTT_BROKER_NS_BEGIN
 
@@ -54,6 +58,7 @@ struct session_state {
     // TODO: Currently not fully implemented...
     session_state(
         as::io_context& ioc,
+        broker_counters& counters,
         sub_con_map& subs_map,
         shared_target& shared_targets,
         con_sp_t con,
@@ -62,22 +67,28 @@ struct session_state {
         optional<std::chrono::steady_clock::duration> will_expiry_interval,
         optional<std::chrono::steady_clock::duration> session_expiry_interval = nullopt)
         :ioc_(ioc),
+         counters_(counters),
          subs_map_(subs_map),
          shared_targets_(shared_targets),
          con_(force_move(con)),
          client_id_(force_move(client_id)),
-         session_expiry_interval_(force_move(session_expiry_interval))
+         session_expiry_interval_(force_move(session_expiry_interval)),
+         offline_messages_(counters)
     {
         update_will(ioc, will, will_expiry_interval);
+        counters_.session_created(online());
     }
 
-    session_state(session_state&&) = default;
+    // A moved-from session_state would call session_destroyed() in its destructor
+    // and the session counters would be decremented twice.
+    session_state(session_state&&) = delete;
 
     ~session_state() {
         MQTT_LOG("mqtt_broker", trace)
             << MQTT_ADD_VALUE(address, this)
             << "session destroy";
         clean();
+        counters_.session_destroyed(online());
     }
 
     bool online() const {
@@ -132,6 +143,7 @@ struct session_state {
         // See
         // https://lists.oasis-open.org/archives/mqtt-comment/202009/msg00000.html
         topic_alias_recv_ = con_->get_topic_alias_recv_container();
+        offline_messages_.release_credit_charges();
         reset_con();
 
         if (session_expiry_interval_ &&
@@ -170,12 +182,17 @@ struct session_state {
         return tim_session_expiry_;
     }
 
+    /**
+     * @brief Publish a message to the client.
+     * @param credit credit of the publisher. If the message is queued, it is charged to the credit.
+     */
     void publish(
         as::io_context& ioc,
         buffer pub_topic,
         buffer contents,
         publish_options pubopts,
-        v5::properties props) {
+        v5::properties props,
+        std::shared_ptr<publisher_credit> const& credit = nullptr) {
 
         BOOST_ASSERT(online());
 
@@ -183,13 +200,17 @@ struct session_state {
             auto qos_value = pubopts.get_qos();
             if (qos_value == qos::at_least_once ||
                 qos_value == qos::exactly_once) {
-                if (auto pid = con_->acquire_unique_packet_id_no_except()) {
+                if (publish_send_count_ >= publish_send_max_) {
+                    // inflight window is full. wait for PUBACK or PUBCOMP.
+                }
+                else if (auto pid = con_->acquire_unique_packet_id_no_except()) {
                     // TODO: Probably this should be switched to async_publish?
                     //       Given the async_client / sync_client seperation
                     //       and the way they have different function names,
                     //       it wouldn't be possible for broker.hpp to be
                     //       used with some hypothetical "async_server" in the future.
                     con_->publish(pid.value(), pub_topic, contents, pubopts, props);
+                    ++publish_send_count_;
                     return;
                 }
             }
@@ -199,13 +220,16 @@ struct session_state {
             }
         }
 
-        // offline_messages_ is not empty or packet_id_exhausted
+        // offline_messages_ is not empty, inflight window is full, or packet_id_exhausted
+        std::shared_ptr<void> credit_charge;
+        if (credit) credit_charge = credit->charge(pub_topic.size() + contents.size());
         offline_messages_.push_back(
             ioc,
             force_move(pub_topic),
             force_move(contents),
             pubopts,
-            force_move(props)
+            force_move(props),
+            force_move(credit_charge)
         );
     }
 
@@ -214,7 +238,8 @@ struct session_state {
         buffer pub_topic,
         buffer contents,
         publish_options pubopts,
-        v5::properties props) {
+        v5::properties props,
+        std::shared_ptr<publisher_credit> const& credit = nullptr) {
 
         if (online()) {
             publish(
@@ -222,7 +247,8 @@ struct session_state {
                 force_move(pub_topic),
                 force_move(contents),
                 pubopts,
-                force_move(props)
+                force_move(props),
+                credit
             );
         }
         else {
@@ -238,6 +264,7 @@ struct session_state {
 
     void clean() {
         topic_alias_recv_ = nullopt;
+        counters_.messages_discarded(inflight_messages_.size());
         inflight_messages_.clear();
         offline_messages_.clear();
         qos2_publish_processed_.clear();
@@ -290,6 +317,7 @@ struct session_state {
                 << "subscription inserted";
 
             handles_.insert(handle_ret.first);
+            counters_.set_subscriptions(subs_map_.size());
             if (rh == retain_handling::send ||
                 rh == retain_handling::send_only_new_subscription) {
                 std::forward<PublishRetainHandler>(h)();
@@ -314,6 +342,7 @@ struct session_state {
         if (handle) {
             handles_.erase(handle.value());
             subs_map_.erase(handle.value(), client_id_);
+            counters_.set_subscriptions(subs_map_.size());
         }
     }
 
@@ -322,6 +351,7 @@ struct session_state {
             subs_map_.erase(h, client_id_);
         }
         handles_.clear();
+        counters_.set_subscriptions(subs_map_.size());
     }
 
     void update_will(
@@ -365,11 +395,13 @@ struct session_state {
 
     void send_inflight_messages() {
         BOOST_ASSERT(con_);
+        // resent messages (PUBLISH and PUBREL) occupy the inflight window
+        publish_send_count_ = inflight_messages_.size();
         inflight_messages_.send_all_messages(*con_);
     }
 
     void erase_inflight_message_by_expiry(std::shared_ptr<as::steady_timer> const& sp) {
-        inflight_messages_.get<tag_tim>().erase(sp);
+        counters_.messages_expired(inflight_messages_.get<tag_tim>().erase(sp));
     }
 
     void erase_inflight_message_by_packet_id(packet_id_t packet_id) {
@@ -377,14 +409,44 @@ struct session_state {
         idx.erase(packet_id);
     }
 
+    /**
+     * @brief Set the maximum number of QoS1 and QoS2 messages that are sent
+     *        to the client concurrently. It is the Receive Maximum of CONNECT.
+     *        Exceeded messages are queued and sent when PUBACK or PUBCOMP is received.
+     * @param max receive maximum
+     */
+    void set_publish_send_max(std::size_t max) {
+        publish_send_max_ = max;
+    }
+
+    std::size_t publish_send_max() const {
+        return publish_send_max_;
+    }
+
+    /**
+     * @brief Get the number of QoS1 and QoS2 messages that are sent to the client
+     *        but not acknowledged yet.
+     * @return number of messages
+     */
+    std::size_t publish_send_count() const {
+        return publish_send_count_;
+    }
+
+    /**
+     * @brief Notify that PUBACK or PUBCOMP is received. It opens the inflight window.
+     */
+    void publish_send_finished() {
+        if (publish_send_count_ > 0) --publish_send_count_;
+    }
+
     void send_all_offline_messages() {
         BOOST_ASSERT(con_);
-        offline_messages_.send_all(*con_);
+        offline_messages_.send_all(*con_, publish_send_count_, publish_send_max_);
     }
 
     void send_offline_messages_by_packet_id_release() {
         BOOST_ASSERT(con_);
-        offline_messages_.send_by_packet_id_release(*con_);
+        offline_messages_.send_by_packet_id_release(*con_, publish_send_count_, publish_send_max_);
     }
 
     buffer const& client_id() const {
@@ -392,11 +454,30 @@ struct session_state {
     }
 
     void reset_con() {
+        if (con_) counters_.session_became_offline();
         con_.reset();
+        publish_send_count_ = 0;
+        credit_.reset();
     }
 
     void reset_con(con_sp_t con) {
+        if (!con_ && con) counters_.session_became_online();
+        else if (con_ && !con) counters_.session_became_offline();
         con_ = force_move(con);
+        publish_send_count_ = 0;
+        credit_.reset();
+    }
+
+    /**
+     * @brief Get the credit of the current connection as a publisher.
+     * @return credit. nullptr if the publisher backpressure is disabled.
+     */
+    std::shared_ptr<publisher_credit> const& credit() const {
+        return credit_;
+    }
+
+    void set_credit(std::shared_ptr<publisher_credit> credit) {
+        credit_ = force_move(credit);
     }
 
     con_sp_t const& con() const {
@@ -424,6 +505,7 @@ private:
     friend class session_states;
 
     as::io_context& ioc_;
+    broker_counters& counters_;
     std::shared_ptr<as::steady_timer> tim_will_expiry_;
     optional<MQTT_NS::will> will_value_;
 
@@ -441,6 +523,9 @@ private:
     std::set<packet_id_t> qos2_publish_processed_;
 
     offline_messages offline_messages_;
+    std::size_t publish_send_max_ = receive_maximum_max;
+    std::size_t publish_send_count_ = 0;
+    std::shared_ptr<publisher_credit> credit_;
 
     std::set<sub_con_map::handle> handles_; // to efficient remove
 };
@@ -120,6 +120,7 @@ struct callable_overlay final : public Impl
      * @return if the handler returns true, then continue receiving, otherwise quit.
      */
     MQTT_ALWAYS_INLINE bool on_connack(bool session_present, connect_return_code return_code) noexcept override final {
+        if (!base::on_connack(session_present, return_code)) return false;
         return    ! h_connack_
                || h_connack_(session_present, return_code);
     }
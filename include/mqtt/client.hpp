@@ -11,6 +11,9 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <random>
 #include <functional>
 #include <type_traits>
 
@@ -397,6 +400,44 @@ public:
         set_keep_alive_sec(keep_alive_sec, std::chrono::seconds(keep_alive_sec / 2));
     }
 
+    /**
+     * @brief Set auto reconnect mode
+     * @param b If true then the client reconnects to the broker automatically when the
+     *          connection is closed by an error.
+     *
+     * The client reconnects with the same client id, user name, password, will, and
+     * CONNECT properties that were used by the last connect() or async_connect() call.
+     * The reconnecting interval grows exponentially from the minimum delay to the maximum
+     * delay with random jitter. See set_reconnect_delay().
+     * If the session is not present on the broker after reconnecting, the subscriptions
+     * that were sent by the client are sent again.
+     * disconnect() and force_disconnect() stop reconnecting.
+     * Stored QoS1 and QoS2 messages are resent by the endpoint. To limit the number of
+     * resent messages in flight, call set_resend_window(). To queue async_publish() calls
+     * while the client is reconnecting, call set_offline_publish_limit().
+     * The default is false.
+     */
+    void set_auto_reconnect(bool b) {
+        auto_reconnect_ = b;
+    }
+
+    /**
+     * @brief Set reconnecting delay
+     * @param min_delay the delay before the first reconnecting
+     * @param max_delay the maximum delay of the exponential backoff
+     *
+     * The delay is doubled for each failed reconnecting, and the actual delay is chosen
+     * randomly between the half of the delay and the delay.
+     * The defaults are 100 milliseconds and 30 seconds.
+     */
+    void set_reconnect_delay(
+        std::chrono::steady_clock::duration min_delay,
+        std::chrono::steady_clock::duration max_delay) {
+        BOOST_ASSERT(min_delay <= max_delay);
+        reconnect_min_delay_ = min_delay;
+        reconnect_max_delay_ = max_delay;
+    }
+
 
     /**
      * @brief Connect to a broker
@@ -731,6 +772,7 @@ public:
         v5::properties props = {}
     ) {
         if (ping_duration_ != std::chrono::steady_clock::duration::zero()) tim_ping_.cancel();
+        stop_reconnect();
         if (base::connected()) {
             std::weak_ptr<this_type> wp(std::static_pointer_cast<this_type>(this->shared_from_this()));
             tim_close_.expires_after(force_move(timeout));
@@ -772,6 +814,7 @@ public:
         v5::properties props = {}
     ) {
         if (ping_duration_ != std::chrono::steady_clock::duration::zero()) tim_ping_.cancel();
+        stop_reconnect();
         if (base::connected()) {
             set_session_expiry_interval_on_disconnect(props);
             base::disconnect(reason_code, force_move(props));
@@ -791,6 +834,7 @@ public:
         std::chrono::steady_clock::duration timeout,
         async_handler_t func = async_handler_t()) {
         if (ping_duration_ != std::chrono::steady_clock::duration::zero()) tim_ping_.cancel();
+        stop_reconnect();
         if (base::connected()) {
             std::weak_ptr<this_type> wp(std::static_pointer_cast<this_type>(this->shared_from_this()));
             tim_close_.expires_after(force_move(timeout));
@@ -834,6 +878,7 @@ public:
         v5::properties props,
         async_handler_t func = async_handler_t()) {
         if (ping_duration_ != std::chrono::steady_clock::duration::zero()) tim_ping_.cancel();
+        stop_reconnect();
         if (base::connected()) {
             std::weak_ptr<this_type> wp(std::static_pointer_cast<this_type>(this->shared_from_this()));
             tim_close_.expires_after(force_move(timeout));
@@ -866,6 +911,7 @@ public:
     void async_disconnect(
         async_handler_t func = async_handler_t()) {
         if (ping_duration_ != std::chrono::steady_clock::duration::zero()) tim_ping_.cancel();
+        stop_reconnect();
         if (base::connected()) {
             base::async_disconnect(force_move(func));
         }
@@ -892,6 +938,7 @@ public:
         v5::properties props,
         async_handler_t func = async_handler_t()) {
         if (ping_duration_ != std::chrono::steady_clock::duration::zero()) tim_ping_.cancel();
+        stop_reconnect();
         if (base::connected()) {
             set_session_expiry_interval_on_disconnect(props);
             base::async_disconnect(reason_code, force_move(props), force_move(func));
@@ -906,6 +953,7 @@ public:
     void force_disconnect() {
         if (ping_duration_ != std::chrono::steady_clock::duration::zero()) tim_ping_.cancel();
         tim_close_.cancel();
+        stop_reconnect();
         base::force_disconnect();
     }
 
@@ -948,7 +996,9 @@ protected:
          path_(force_move(path))
 #endif // defined(MQTT_USE_WS)
          ,
-         tim_session_expiry_(ioc_)
+         tim_session_expiry_(ioc_),
+         tim_reconnect_(ioc_),
+         reconnect_rand_(std::random_device()())
     {
 #if defined(MQTT_USE_TLS)
         ctx_.set_verify_mode(tls::verify_peer);
@@ -1223,6 +1273,7 @@ private:
     void connect_impl(
         v5::properties props,
         any session_life_keeper) {
+        prepare_reconnect(props);
         as::ip::tcp::resolver r(ioc_);
         auto eps = r.resolve(host_, port_);
         as::connect(socket_->lowest_layer(), eps.begin(), eps.end());
@@ -1238,6 +1289,7 @@ private:
         v5::properties props,
         any session_life_keeper,
         boost::system::error_code& ec) {
+        prepare_reconnect(props);
         as::ip::tcp::resolver r(ioc_);
         auto eps = r.resolve(host_, port_, ec);
         if (ec) return;
@@ -1255,6 +1307,7 @@ private:
         v5::properties props,
         any session_life_keeper,
         async_handler_t func) {
+        prepare_reconnect(props);
         auto r = std::make_shared<as::ip::tcp::resolver>(ioc_);
         auto p = r.get();
         p->async_resolve(
@@ -1309,6 +1362,24 @@ protected:
         }
     }
 
+    void on_subscribe_sending(std::vector<std::tuple<as::const_buffer, subscribe_options>> const& params) noexcept override {
+        if (!auto_reconnect_) return;
+        std::lock_guard<std::mutex> g(subscriptions_mtx_);
+        for (auto const& e : params) {
+            auto const& topic = std::get<0>(e);
+            auto r = subscriptions_.emplace(std::string(get_pointer(topic), get_size(topic)), std::get<1>(e));
+            if (!r.second) r.first->second = std::get<1>(e);
+        }
+    }
+
+    void on_unsubscribe_sending(std::vector<as::const_buffer> const& params) noexcept override {
+        if (!auto_reconnect_) return;
+        std::lock_guard<std::mutex> g(subscriptions_mtx_);
+        for (auto const& topic : params) {
+            subscriptions_.erase(std::string(get_pointer(topic), get_size(topic)));
+        }
+    }
+
 private:
     void handle_timer(error_code ec) {
         if (!ec) {
@@ -1390,16 +1461,86 @@ private:
 
     }
 
+    void prepare_reconnect(v5::properties const& props) {
+        reconnect_stopped_ = false;
+        if (auto_reconnect_) connect_props_ = props;
+    }
+
+    void stop_reconnect() {
+        reconnect_stopped_ = true;
+        tim_reconnect_.cancel();
+    }
+
+    void schedule_reconnect() {
+        if (!auto_reconnect_ || reconnect_stopped_) return;
+        auto delay = reconnect_min_delay_;
+        for (std::size_t i = 0; i != reconnect_attempts_ && delay < reconnect_max_delay_; ++i) {
+            delay *= 2;
+        }
+        if (delay > reconnect_max_delay_) delay = reconnect_max_delay_;
+        ++reconnect_attempts_;
+        // Choose the delay from [delay/2, delay] to avoid that many clients reconnect at once.
+        std::uniform_int_distribution<std::chrono::steady_clock::duration::rep> dist(delay.count() / 2, delay.count());
+        tim_reconnect_.expires_after(std::chrono::steady_clock::duration(dist(reconnect_rand_)));
+        std::weak_ptr<this_type> wp(std::static_pointer_cast<this_type>(this->shared_from_this()));
+        tim_reconnect_.async_wait(
+            [wp = force_move(wp)](error_code ec) {
+                if (auto sp = wp.lock()) {
+                    if (!ec) sp->reconnect();
+                }
+            }
+        );
+    }
+
+    void reconnect() {
+        if (reconnect_stopped_) return;
+        setup_socket(socket_);
+        std::weak_ptr<this_type> wp(std::static_pointer_cast<this_type>(this->shared_from_this()));
+        async_connect_impl(
+            connect_props_,
+            any(),
+            [wp = force_move(wp)](error_code ec) {
+                if (!ec) return;
+                if (auto sp = wp.lock()) {
+                    sp->schedule_reconnect();
+                }
+            }
+        );
+    }
+
+    void on_connected(bool session_present) {
+        reconnect_attempts_ = 0;
+        if (!auto_reconnect_ || session_present) return;
+        std::vector<std::tuple<std::string, subscribe_options>> params;
+        {
+            std::lock_guard<std::mutex> g(subscriptions_mtx_);
+            params.reserve(subscriptions_.size());
+            for (auto const& e : subscriptions_) {
+                params.emplace_back(e.first, e.second);
+            }
+        }
+        if (params.empty()) return;
+        if (auto pid = base::acquire_unique_packet_id_no_except()) {
+            base::async_subscribe(pid.value(), force_move(params));
+        }
+    }
+
 public:
     void cancel_session_expiry_timer() {
         tim_session_expiry_.cancel();
     }
 
 protected:
-    bool on_v5_connack(bool /*session_present*/,
-                       v5::connect_reason_code /*reason_code*/,
+    bool on_connack(bool session_present, connect_return_code return_code) noexcept override {
+        if (return_code == connect_return_code::accepted) on_connected(session_present);
+        return true;
+    }
+
+    bool on_v5_connack(bool session_present,
+                       v5::connect_reason_code reason_code,
                        v5::properties props) noexcept override {
         cancel_session_expiry_timer();
+        if (reason_code == v5::connect_reason_code::success) on_connected(session_present);
 
         // The current implementation is simply
         // overwrite by broker's session expiry interval
@@ -1424,6 +1565,7 @@ protected:
         (void)ec;
         if (ping_duration_ != std::chrono::steady_clock::duration::zero()) tim_ping_.cancel();
         set_session_expiry_timer();
+        schedule_reconnect();
     }
 
     // Ensure that only code that knows the *exact* type of an object
@@ -1476,6 +1618,16 @@ private:
 #endif // defined(MQTT_USE_WS)
     session_expiry_interval_t session_expiry_interval_ = 0;
     as::steady_timer tim_session_expiry_;
+    bool auto_reconnect_ = false;
+    bool reconnect_stopped_ = false;
+    std::size_t reconnect_attempts_ = 0;
+    std::chrono::steady_clock::duration reconnect_min_delay_ = std::chrono::milliseconds(100);
+    std::chrono::steady_clock::duration reconnect_max_delay_ = std::chrono::seconds(30);
+    as::steady_timer tim_reconnect_;
+    std::minstd_rand reconnect_rand_;
+    v5::properties connect_props_;
+    std::mutex subscriptions_mtx_;
+    std::map<std::string, subscribe_options> subscriptions_;
 };
 
 inline std::shared_ptr<callable_overlay<client<tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>>>>
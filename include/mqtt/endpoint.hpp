@@ -45,6 +45,7 @@
 #include <mqtt/session_present.hpp>
 #include <mqtt/subscribe_options.hpp>
 #include <mqtt/publish.hpp>
+#include <mqtt/publish_batch_entry.hpp>
 #include <mqtt/connect_return_code.hpp>
 #include <mqtt/exception.hpp>
 #include <mqtt/tcp_endpoint.hpp>
@@ -60,6 +61,7 @@
 #include <mqtt/buffer.hpp>
 #include <mqtt/shared_ptr_array.hpp>
 #include <mqtt/type_erased_socket.hpp>
+#include <mqtt/static_socket.hpp>
 #include <mqtt/move.hpp>
 #include <mqtt/deprecated.hpp>
 #include <mqtt/deprecated_msg.hpp>
@@ -69,6 +71,7 @@
 #include <mqtt/topic_alias_recv.hpp>
 #include <mqtt/subscribe_entry.hpp>
 #include <mqtt/shared_subscriptions.hpp>
+#include <mqtt/endpoint_counters.hpp>
 
 #if defined(MQTT_USE_WS)
 #include <mqtt/ws_endpoint.hpp>
@@ -158,14 +161,26 @@ constexpr bool should_generate_packet_id(Params const& ... params) {
 namespace as = boost::asio;
 namespace mi = boost::multi_index;
 
-template <typename Mutex = std::mutex, template<typename...> class LockGuard = std::lock_guard, std::size_t PacketIdBytes = 2>
-class endpoint : public std::enable_shared_from_this<endpoint<Mutex, LockGuard, PacketIdBytes>> {
-    using this_type = endpoint<Mutex, LockGuard, PacketIdBytes>;
+/**
+ * @brief MQTT endpoint
+ * @tparam Socket
+ *         Holder of the socket. MQTT_NS::socket (default) is type erased.
+ *         static_socket calls the concrete socket without type erasure.
+ */
+template <
+    typename Mutex = std::mutex,
+    template<typename...> class LockGuard = std::lock_guard,
+    std::size_t PacketIdBytes = 2,
+    typename Socket = MQTT_NS::socket
+>
+class endpoint : public std::enable_shared_from_this<endpoint<Mutex, LockGuard, PacketIdBytes, Socket>> {
+    using this_type = endpoint<Mutex, LockGuard, PacketIdBytes, Socket>;
     using this_type_sp = std::shared_ptr<this_type>;
 
 public:
     using async_handler_t = std::function<void(error_code ec)>;
     using packet_id_t = typename packet_id_type<PacketIdBytes>::type;
+    using socket_t = Socket;
 
     /**
      * @brief Constructor for client
@@ -186,8 +201,8 @@ public:
      * @brief Constructor for server.
      *        socket should have already been connected with another endpoint.
      */
-    template <typename Socket>
-    explicit endpoint(as::io_context& ioc, std::shared_ptr<Socket> socket, protocol_version version = protocol_version::undetermined, bool async_send_store = false)
+    template <typename ActualSocket>
+    explicit endpoint(as::io_context& ioc, std::shared_ptr<ActualSocket> socket, protocol_version version = protocol_version::undetermined, bool async_send_store = false)
         :socket_(force_move(socket)),
          connected_(true),
          async_send_store_{async_send_store},
@@ -769,6 +784,20 @@ protected:
      */
     virtual void on_pre_send() noexcept = 0;
 
+    /**
+     * @brief Subscribe sending handler
+     *        This handler is called when a subscribe packet is decided to send.
+     * @param params topic filters and subscribe options
+     */
+    virtual void on_subscribe_sending(std::vector<std::tuple<as::const_buffer, subscribe_options>> const& params) noexcept = 0;
+
+    /**
+     * @brief Unsubscribe sending handler
+     *        This handler is called when an unsubscribe packet is decided to send.
+     * @param params topic filters
+     */
+    virtual void on_unsubscribe_sending(std::vector<as::const_buffer> const& params) noexcept = 0;
+
 private:
     /**
      * @brief is valid length handler
@@ -826,7 +855,7 @@ public:
      * @return The total bytes received on the socket.
      */
     std::size_t get_total_bytes_received() const {
-        return total_bytes_received_;
+        return counters_.bytes_received();
     }
 
     /**
@@ -834,7 +863,26 @@ public:
      * @return The total bytes sent on the socket.
      */
     std::size_t get_total_bytes_sent() const {
-        return total_bytes_sent_;
+        return counters_.bytes_sent();
+    }
+
+    /**
+     * @brief Get performance counters.
+     *
+     * The counters can be read from any thread.
+     * Call get_counters().get_snapshot() to get a copy of all counters.
+     * @return counters of this endpoint
+     */
+    endpoint_counters& get_counters() {
+        return counters_;
+    }
+
+    /**
+     * @brief Get performance counters.
+     * @return counters of this endpoint
+     */
+    endpoint_counters const& get_counters() const {
+        return counters_;
     }
 
     /**
@@ -2564,6 +2612,123 @@ public:
             force_move(func)
         );
     }
+
+    /**
+     * @brief Publish multiple messages at once
+     *        Packet ids of the QoS1 and QoS2 messages are acquired under one lock,
+     *        and the messages are stored under one lock.
+     *        The messages are queued by one post and sent by one write regardless of
+     *        set_max_queue_send_count() and set_max_queue_send_size().
+     * @param entries
+     *        Messages to publish. Their topic names and contents are kept alive
+     *        until all the stored messages of the batch are released.
+     * @param func
+     *        functor object who's operator() will be called when the whole batch is written.
+     * @return packet ids of the entries in the same order. 0 for at_most_once entries.
+     *         If packet ids are exhausted, no message is published and packet_id_exhausted_error is thrown.
+     */
+    std::vector<packet_id_t> async_publish_batch(
+        std::vector<publish_batch_entry> entries,
+        async_handler_t func = {}
+    ) {
+        MQTT_LOG("mqtt_api", info)
+            << MQTT_ADD_VALUE(address, this)
+            << "async_publish_batch"
+            << " size:" << entries.size();
+
+        auto sp_entries = std::make_shared<std::vector<publish_batch_entry>>(force_move(entries));
+        std::vector<packet_id_t> packet_ids(sp_entries->size(), 0);
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            for (std::size_t i = 0; i != sp_entries->size(); ++i) {
+                if ((*sp_entries)[i].pubopts.get_qos() == qos::at_most_once) continue;
+                if (auto pid = acquire_unique_packet_id_no_lock()) {
+                    packet_ids[i] = pid.value();
+                    continue;
+                }
+                for (auto packet_id : packet_ids) {
+                    if (packet_id != 0) packet_id_.erase(packet_id);
+                }
+                throw packet_id_exhausted_error();
+            }
+        }
+
+        std::vector<basic_message_variant<PacketIdBytes>> mvs;
+        mvs.reserve(sp_entries->size());
+        auto do_async_send_publish_batch =
+            [&](auto make_msg, auto const& serialize_publish) {
+                using msg_t = decltype(make_msg(std::declval<publish_batch_entry&>(), packet_id_t()));
+                std::vector<msg_t> store_msgs;
+                for (std::size_t i = 0; i != sp_entries->size(); ++i) {
+                    auto msg = make_msg((*sp_entries)[i], packet_ids[i]);
+                    if (packet_ids[i] != 0) {
+                        store_msgs.push_back(msg);
+                        store_msgs.back().set_dup(true);
+                    }
+                    mvs.emplace_back(force_move(msg));
+                }
+                {
+                    LockGuard<Mutex> lck (store_mtx_);
+                    for (auto const& store_msg : store_msgs) {
+                        auto ret = store_.emplace(
+                            store_msg.packet_id(),
+                            store_msg.get_qos() == qos::at_least_once ? control_packet_type::puback
+                                                                      : control_packet_type::pubrec,
+                            store_msg,
+                            sp_entries
+                        );
+                        (void)ret;
+                        BOOST_ASSERT(ret.second);
+                    }
+                    counters_.set_store_size(store_.size());
+                }
+                for (auto& store_msg : store_msgs) {
+                    (this->*serialize_publish)(force_move(store_msg));
+                }
+            };
+
+        switch (version_) {
+        case protocol_version::v3_1_1:
+            do_async_send_publish_batch(
+                [](publish_batch_entry& e, packet_id_t packet_id) {
+                    return v3_1_1::basic_publish_message<PacketIdBytes>(
+                        packet_id,
+                        as::buffer(e.topic_name),
+                        as::buffer(e.contents),
+                        e.pubopts
+                    );
+                },
+                &endpoint::on_serialize_publish_message
+            );
+            break;
+        case protocol_version::v5:
+            do_async_send_publish_batch(
+                [](publish_batch_entry& e, packet_id_t packet_id) {
+                    return v5::basic_publish_message<PacketIdBytes>(
+                        packet_id,
+                        as::buffer(e.topic_name),
+                        as::buffer(e.contents),
+                        e.pubopts,
+                        force_move(e.props)
+                    );
+                },
+                &endpoint::on_serialize_v5_publish_message
+            );
+            break;
+        default:
+            BOOST_ASSERT(false);
+            break;
+        }
+
+        do_async_write(
+            force_move(mvs),
+            [life_keeper = force_move(sp_entries), func = force_move(func)](error_code ec) {
+                if (func) func(ec);
+            }
+        );
+        return packet_ids;
+    }
+
     /**
      * @brief Subscribe
      * @param packet_id
@@ -4132,6 +4297,7 @@ public:
         auto& idx = store_.template get<tag_packet_id>();
         auto r = idx.equal_range(packet_id);
         idx.erase(std::get<0>(r), std::get<1>(r));
+        counters_.set_store_size(store_.size());
         packet_id_.erase(packet_id);
     }
 
@@ -4208,41 +4374,7 @@ public:
      */
     optional<packet_id_t> acquire_unique_packet_id_no_except() {
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.size() == std::numeric_limits<packet_id_t>::max()) return nullopt;
-        if (packet_id_master_ == std::numeric_limits<packet_id_t>::max()) {
-            packet_id_master_ = 1U;
-        }
-        else {
-            ++packet_id_master_;
-        }
-        auto ret = packet_id_.insert(packet_id_master_);
-        if (ret.second) return packet_id_master_;
-
-        auto last = packet_id_.end();
-        auto e = last;
-        --last;
-
-        if (*last != std::numeric_limits<packet_id_t>::max()) {
-            packet_id_master_ = static_cast<packet_id_t>(*last + 1U);
-            packet_id_.insert(e, packet_id_master_);
-            return packet_id_master_;
-        }
-
-        auto b = packet_id_.begin();
-        auto prev = *b;
-        if (prev != 1U) {
-            packet_id_master_ = 1U;
-            packet_id_.insert(b, packet_id_master_);
-            return packet_id_master_;
-        }
-        ++b;
-        while (*b - 1U == prev && b != e) {
-            prev = *b;
-            ++b;
-        }
-        packet_id_master_ = static_cast<packet_id_t>(prev + 1U);
-        packet_id_.insert(b, packet_id_master_);
-        return packet_id_master_;
+        return acquire_unique_packet_id_no_lock();
     }
 
     /**
@@ -4336,6 +4468,7 @@ public:
                 force_move(msg),
                 force_move(life_keeper)
             );
+            counters_.set_store_size(store_.size());
             // When client want to restore serialized messages,
             // endpoint might keep the message that has the same packet_id.
             // In this case, overwrite store_.
@@ -4371,6 +4504,7 @@ public:
                 force_move(msg),
                 force_move(life_keeper)
             );
+            counters_.set_store_size(store_.size());
             // When client want to restore serialized messages,
             // endpoint might keep the message that has the same packet_id.
             // In this case, overwrite store_.
@@ -4442,6 +4576,7 @@ public:
                 force_move(msg),
                 force_move(life_keeper)
             );
+            counters_.set_store_size(store_.size());
             // When client want to restore serialized messages,
             // endpoint might keep the message that has the same packet_id.
             // In this case, overwrite store_.
@@ -4479,6 +4614,7 @@ public:
                 force_move(msg),
                 force_move(life_keeper)
             );
+            counters_.set_store_size(store_.size());
             // When client want to restore serialized messages,
             // endpoint might keep the message that has the same packet_id.
             // In this case, overwrite store_.
@@ -4549,6 +4685,7 @@ public:
                         store_msg,
                         force_move(life_keeper)
                     );
+                    counters_.set_store_size(store_.size());
                     (this->*serialize)(force_move(store_msg));
                 }
                 do_sync_write(force_move(msg));
@@ -4566,6 +4703,7 @@ public:
                     msg,
                     force_move(life_keeper)
                 );
+                counters_.set_store_size(store_.size());
                 (void)ret;
                 BOOST_ASSERT(ret.second);
                 (this->*serialize)(msg);
@@ -4624,6 +4762,7 @@ public:
                         store_msg,
                         force_move(life_keeper)
                     );
+                    counters_.set_store_size(store_.size());
                     (this->*serialize)(force_move(store_msg));
                 }
                 do_async_write(force_move(msg), force_move(func));
@@ -4641,6 +4780,7 @@ public:
                     msg,
                     force_move(life_keeper)
                 );
+                counters_.set_store_size(store_.size());
                 (void)ret;
                 BOOST_ASSERT(ret.second);
                 (this->*serialize)(msg);
@@ -4694,6 +4834,26 @@ public:
         return connected_;
     }
 
+    /**
+     * @brief Set auto next read mode.
+     *        If true (default), the next mqtt message is read automatically
+     *        when the current mqtt message has been processed.
+     *        If false, call async_read_next_message() to read the next message.
+     *        It can be changed in the message handler to stop reading after the message.
+     * @param val auto next read mode
+     */
+    void set_auto_next_read(bool val) {
+        async_read_on_message_processed_ = val;
+    }
+
+    /**
+     * @brief Get auto next read mode.
+     * @return auto next read mode
+     */
+    bool auto_next_read() const {
+        return async_read_on_message_processed_;
+    }
+
     /**
      * @brief Trigger next mqtt message manually.
      *        If you call this function, you need to set manual receive mode
@@ -4735,15 +4895,45 @@ public:
         max_queue_send_size_ = size;
     }
 
+    /**
+     * @brief Set the resend window.
+     *        When the session is resumed, stored publish and pubrel messages are resent.
+     *        This value limits the number of resent messages that are waiting for the
+     *        acknowledgement. When a resent message is acknowledged, the next stored
+     *        message is sent.
+     *        The default value is 0.
+     *
+     * @param window maximum number of resent messages in flight. 0 means infinity.
+     *
+     */
+    void set_resend_window(std::size_t window) {
+        resend_window_ = window;
+    }
+
+    /**
+     * @brief Set the maximum number of queued offline publish messages.
+     *        If the value is not 0, async_publish() called while the underlying
+     *        connection is closed is queued instead of failing. The queued messages
+     *        are sent in order after the next CONNACK is received.
+     *        If the queue is full, the handler is called with no_buffer_space error.
+     *        The default value is 0.
+     *
+     * @param limit maximum number of queued messages. 0 means offline publish is disabled.
+     *
+     */
+    void set_offline_publish_limit(std::size_t limit) {
+        offline_publish_limit_ = limit;
+    }
+
     protocol_version get_protocol_version() const {
         return version_;
     }
 
-    MQTT_NS::socket const& socket() const {
+    Socket const& socket() const {
         return socket_.value();
     }
 
-    MQTT_NS::socket& socket() {
+    Socket& socket() {
         return socket_.value();
     }
 
@@ -4790,10 +4980,10 @@ public:
 protected:
 
     /**
-     * @brief Get shared_any of socket
-     * @return reference of shared_any socket
+     * @brief Get holder of socket
+     * @return reference of the socket holder
      */
-    optional<MQTT_NS::socket>& socket_optional() {
+    optional<Socket>& socket_optional() {
         return socket_;
     }
 
@@ -4803,7 +4993,6 @@ protected:
             [this, self = this->shared_from_this(), session_life_keeper = force_move(session_life_keeper)](
                 error_code ec,
                 std::size_t bytes_transferred) mutable {
-                this->total_bytes_received_ += bytes_transferred;
                 if (!check_error_and_transferred_length(ec, bytes_transferred, 1)) return;
                 handle_control_packet_type(force_move(session_life_keeper), force_move(self));
             }
@@ -4846,7 +5035,9 @@ protected:
         {
             LockGuard<Mutex> lck (store_mtx_);
             store_.clear();
+            counters_.set_store_size(store_.size());
             packet_id_.clear();
+            resend_queue_.clear();
         }
         {
             LockGuard<Mutex> lck (topic_alias_recv_mtx_);
@@ -4855,6 +5046,45 @@ protected:
     }
 
 private:
+    // store_mtx_ must be locked by the caller
+    optional<packet_id_t> acquire_unique_packet_id_no_lock() {
+        if (packet_id_.size() == std::numeric_limits<packet_id_t>::max()) return nullopt;
+        if (packet_id_master_ == std::numeric_limits<packet_id_t>::max()) {
+            packet_id_master_ = 1U;
+        }
+        else {
+            ++packet_id_master_;
+        }
+        auto ret = packet_id_.insert(packet_id_master_);
+        if (ret.second) return packet_id_master_;
+
+        auto last = packet_id_.end();
+        auto e = last;
+        --last;
+
+        if (*last != std::numeric_limits<packet_id_t>::max()) {
+            packet_id_master_ = static_cast<packet_id_t>(*last + 1U);
+            packet_id_.insert(e, packet_id_master_);
+            return packet_id_master_;
+        }
+
+        auto b = packet_id_.begin();
+        auto prev = *b;
+        if (prev != 1U) {
+            packet_id_master_ = 1U;
+            packet_id_.insert(b, packet_id_master_);
+            return packet_id_master_;
+        }
+        ++b;
+        while (*b - 1U == prev && b != e) {
+            prev = *b;
+            ++b;
+        }
+        packet_id_master_ = static_cast<packet_id_t>(prev + 1U);
+        packet_id_.insert(b, packet_id_master_);
+        return packet_id_master_;
+    }
+
     bool check_transferred_length(
         std::size_t bytes_transferred,
         std::size_t bytes_expected) {
@@ -4888,7 +5118,7 @@ private:
         mqtt_connected_ = false;
 
         boost::system::error_code ec;
-        socket.lowest_layer().close(ec);
+        socket.force_shutdown_and_close(ec);
     }
 
     class send_buffer {
@@ -4979,7 +5209,17 @@ private:
         >
     >;
 
+    void mqtt_message_processed(any session_life_keeper) {
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        counters_.process_latency().record(std::chrono::steady_clock::now() - dispatched_at_);
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+        on_mqtt_message_processed(force_move(session_life_keeper));
+    }
+
     void handle_control_packet_type(any session_life_keeper, this_type_sp self) {
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        read_completed_at_ = std::chrono::steady_clock::now();
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
         fixed_header_ = static_cast<std::uint8_t>(buf_.front());
         remaining_length_ = 0;
         remaining_length_multiplier_ = 1;
@@ -4988,7 +5228,6 @@ private:
             [this, self = force_move(self), session_life_keeper = force_move(session_life_keeper)] (
                 error_code ec,
                 std::size_t bytes_transferred) mutable {
-                this->total_bytes_received_ += bytes_transferred;
                 if (!check_error_and_transferred_length(ec, bytes_transferred, 1)) return;
                 handle_remaining_length(force_move(session_life_keeper), force_move(self));
             }
@@ -5012,7 +5251,6 @@ private:
                 [this, self = force_move(self), session_life_keeper = force_move(session_life_keeper)](
                     error_code ec,
                     std::size_t bytes_transferred) mutable {
-                    this->total_bytes_received_ += bytes_transferred;
                     if (handle_close_or_error(ec)) {
                         return;
                     }
@@ -5091,6 +5329,16 @@ private:
 
     void process_payload(any session_life_keeper, this_type_sp self) {
         auto control_packet_type = get_control_packet_type(fixed_header_);
+        {
+            // fixed header + remaining length bytes + remaining length
+            std::size_t packet_size = 1 + remaining_length_;
+            for (auto m = remaining_length_multiplier_; m > 1; m /= 128) ++packet_size;
+            counters_.packet_received(control_packet_type, packet_size);
+        }
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        dispatched_at_ = std::chrono::steady_clock::now();
+        counters_.receive_latency().record(dispatched_at_ - read_completed_at_);
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
         switch (control_packet_type) {
         case control_packet_type::connect:
             process_connect(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
@@ -5225,7 +5473,6 @@ private:
                 ]
                 (error_code ec,
                  std::size_t bytes_transferred) mutable {
-                    this->total_bytes_received_ += bytes_transferred;
                     if (!check_error_and_transferred_length(ec, bytes_transferred, buf.size())) return;
                     handler(
                         force_move(buf),
@@ -5275,7 +5522,6 @@ private:
                 ]
                 (error_code ec,
                  std::size_t bytes_transferred) mutable {
-                    this->total_bytes_received_ += bytes_transferred;
                     if (!check_error_and_transferred_length(ec, bytes_transferred, Bytes)) return;
                     handler(
                         make_packet_id<Bytes>::apply(
@@ -5390,7 +5636,6 @@ private:
                 ]
                 (error_code ec,
                  std::size_t bytes_transferred) mutable {
-                    this->total_bytes_received_ += bytes_transferred;
                     if (!check_error_and_transferred_length(ec, bytes_transferred, 1)) return;
                     proc(
                         force_move(session_life_keeper),
@@ -5553,7 +5798,6 @@ private:
                             result
                         ]
                         (error_code ec, std::size_t bytes_transferred) mutable {
-                            this->total_bytes_received_ += bytes_transferred;
                             if (!check_error_and_transferred_length(ec, bytes_transferred, result.len)) return;
                             process_property_id(
                                 force_move(session_life_keeper),
@@ -5609,7 +5853,6 @@ private:
                 ]
                 (error_code ec,
                  std::size_t bytes_transferred) mutable {
-                    this->total_bytes_received_ += bytes_transferred;
                     if (!check_error_and_transferred_length(ec, bytes_transferred, 1)) return;
                     process_property_body(
                         force_move(session_life_keeper),
@@ -6516,7 +6759,6 @@ private:
                     self = force_move(self)
                 ]
                 (error_code ec, std::size_t bytes_transferred) mutable {
-                    this->total_bytes_received_ += bytes_transferred;
                     if (!check_error_and_transferred_length(ec, bytes_transferred, remaining_length_)) return;
                     (this->*NextFunc)(
                         force_move(session_life_keeper),
@@ -6550,7 +6792,6 @@ private:
             ]
             (error_code ec,
              std::size_t bytes_transferred) mutable {
-                this->total_bytes_received_ += bytes_transferred;
                 if (!check_error_and_transferred_length(ec, bytes_transferred, header_len)) return;
                 (this->*NextFunc)(
                     force_move(session_life_keeper),
@@ -6904,7 +7145,7 @@ private:
                         info.keep_alive
                     )
                 ) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             case protocol_version::v5:
@@ -6924,7 +7165,7 @@ private:
                         force_move(info.props)
                     )
                 ) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             default:
@@ -7042,11 +7283,20 @@ private:
             break;
         case connack_phase::finish: {
             mqtt_connected_ = true;
+            // Note: boost:variant has no featue to query if the variant currently holds a specific type.
+            // MQTT_CPP could create a type traits function to match the provided type to the index in
+            // the boost::variant type list, but for now it does not appear to be needed.
+            bool accepted =
+                   (   (0 == variant_idx(info.reason_code))
+                    && (connect_return_code::accepted == variant_get<connect_return_code>(info.reason_code)))
+                || (   (1 == variant_idx(info.reason_code))
+                    && (v5::connect_reason_code::success == variant_get<v5::connect_reason_code>(info.reason_code)));
+
             // I use rvalue reference parameter to reduce move constructor calling.
             // This is a local lambda expression invoked from this function, so
             // I can control all callers.
             auto connack_proc =
-                [this]
+                [this, accepted]
                 (
                     any&& session_life_keeper,
                     connack_info&& info
@@ -7055,14 +7305,17 @@ private:
                     case protocol_version::v3_1_1:
                         if(on_connack(info.session_present,
                                       variant_get<connect_return_code>(info.reason_code))) {
-                            on_mqtt_message_processed(force_move(session_life_keeper));
+                            // Offline publishes are sent after the stored messages.
+                            if (accepted) flush_offline_publishes();
+                            mqtt_message_processed(force_move(session_life_keeper));
                         }
                         break;
                     case protocol_version::v5:
                         if (on_v5_connack(info.session_present,
                                           variant_get<v5::connect_reason_code>(info.reason_code),
                                           force_move(info.props))) {
-                            on_mqtt_message_processed(force_move(session_life_keeper));
+                            if (accepted) flush_offline_publishes();
+                            mqtt_message_processed(force_move(session_life_keeper));
                         }
                         break;
                     default:
@@ -7070,13 +7323,7 @@ private:
                     }
                 };
 
-            // Note: boost:variant has no featue to query if the variant currently holds a specific type.
-            // MQTT_CPP could create a type traits function to match the provided type to the index in
-            // the boost::variant type list, but for now it does not appear to be needed.
-            if (   (   (0 == variant_idx(info.reason_code))
-                    && (connect_return_code::accepted == variant_get<connect_return_code>(info.reason_code)))
-                || (   (1 == variant_idx(info.reason_code))
-                    && (v5::connect_reason_code::success == variant_get<v5::connect_reason_code>(info.reason_code)))) {
+            if (accepted) {
                 if (clean_session_) {
                     clear_session_data();
                 }
@@ -7272,7 +7519,7 @@ private:
                                             publish_options(fixed_header_),
                                             force_move(info.topic_name),
                                             force_move(payload))) {
-                                    on_mqtt_message_processed(force_move(session_life_keeper));
+                                    mqtt_message_processed(force_move(session_life_keeper));
                                     return true;
                                 }
                                 break;
@@ -7310,7 +7557,7 @@ private:
                                             force_move(info.props)
                                     )
                                 ) {
-                                    on_mqtt_message_processed(force_move(session_life_keeper));
+                                    mqtt_message_processed(force_move(session_life_keeper));
                                     return true;
                                 }
                                 break;
@@ -7517,18 +7764,20 @@ private:
                 auto& idx = store_.template get<tag_packet_id_type>();
                 auto r = idx.equal_range(std::make_tuple(info.packet_id, control_packet_type::puback));
                 idx.erase(std::get<0>(r), std::get<1>(r));
+                counters_.set_store_size(store_.size());
                 packet_id_.erase(info.packet_id);
             }
             on_serialize_remove(info.packet_id);
+            resend_next();
             switch (version_) {
             case protocol_version::v3_1_1:
                 if (on_puback(info.packet_id)) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             case protocol_version::v5:
                 if (on_v5_puback(info.packet_id, info.reason_code, force_move(info.props))) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             default:
@@ -7677,6 +7926,7 @@ private:
                 auto& idx = store_.template get<tag_packet_id_type>();
                 auto r = idx.equal_range(std::make_tuple(info.packet_id, control_packet_type::pubrec));
                 idx.erase(std::get<0>(r), std::get<1>(r));
+                counters_.set_store_size(store_.size());
                 // packet_id shouldn't be erased here.
                 // It is reused for pubrel/pubcomp.
             }
@@ -7720,13 +7970,13 @@ private:
             case protocol_version::v3_1_1:
                 if (on_pubrec(info.packet_id)) {
                     res();
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             case protocol_version::v5:
                 if (on_v5_pubrec(info.packet_id, info.reason_code, force_move(info.props))) {
                     res();
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             default:
@@ -7897,13 +8147,13 @@ private:
             case protocol_version::v3_1_1:
                 if (on_pubrel(info.packet_id)) {
                     res();
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             case protocol_version::v5:
                 if (on_v5_pubrel(info.packet_id, info.reason_code, force_move(info.props))) {
                     res();
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             default:
@@ -8052,18 +8302,20 @@ private:
                 auto& idx = store_.template get<tag_packet_id_type>();
                 auto r = idx.equal_range(std::make_tuple(info.packet_id, control_packet_type::pubcomp));
                 idx.erase(std::get<0>(r), std::get<1>(r));
+                counters_.set_store_size(store_.size());
                 packet_id_.erase(info.packet_id);
             }
             on_serialize_remove(info.packet_id);
+            resend_next();
             switch (version_) {
             case protocol_version::v3_1_1:
                 if (on_pubcomp(info.packet_id)) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             case protocol_version::v5:
                 if (on_v5_pubcomp(info.packet_id, info.reason_code, force_move(info.props))) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             default:
@@ -8226,12 +8478,12 @@ private:
             switch (version_) {
             case protocol_version::v3_1_1:
                 if (on_subscribe(info.packet_id, force_move(info.entries))) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             case protocol_version::v5:
                 if (on_v5_subscribe(info.packet_id, force_move(info.entries), force_move(info.props))) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             default:
@@ -8374,7 +8626,7 @@ private:
                             }
                         );
                         if (on_suback(info.packet_id, force_move(results))) {
-                            on_mqtt_message_processed(force_move(session_life_keeper));
+                            mqtt_message_processed(force_move(session_life_keeper));
                         }
                         break;
                     }
@@ -8401,7 +8653,7 @@ private:
                             }
                         );
                         if (on_v5_suback(info.packet_id, force_move(reasons), force_move(info.props))) {
-                            on_mqtt_message_processed(force_move(session_life_keeper));
+                            mqtt_message_processed(force_move(session_life_keeper));
                         }
                         break;
                     }
@@ -8546,12 +8798,12 @@ private:
             switch (version_) {
             case protocol_version::v3_1_1:
                 if (on_unsubscribe(info.packet_id, force_move(info.entries))) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             case protocol_version::v5:
                 if (on_v5_unsubscribe(info.packet_id, force_move(info.entries), force_move(info.props))) {
-                    on_mqtt_message_processed(force_move(session_life_keeper));
+                    mqtt_message_processed(force_move(session_life_keeper));
                 }
                 break;
             default:
@@ -8624,7 +8876,7 @@ private:
                     switch (version_) {
                     case protocol_version::v3_1_1:
                         if (on_unsuback(info.packet_id)) {
-                            on_mqtt_message_processed(force_move(session_life_keeper));
+                            mqtt_message_processed(force_move(session_life_keeper));
                         }
                         break;
                     case protocol_version::v5:
@@ -8691,7 +8943,7 @@ private:
                         }
                     );
                     if (on_v5_unsuback(info.packet_id, force_move(reasons), force_move(info.props))) {
-                        on_mqtt_message_processed(force_move(session_life_keeper));
+                        mqtt_message_processed(force_move(session_life_keeper));
                     }
                 },
                 force_move(self)
@@ -8712,7 +8964,7 @@ private:
             return;
         }
         if (on_pingreq()) {
-            on_mqtt_message_processed(force_move(session_life_keeper));
+            mqtt_message_processed(force_move(session_life_keeper));
         }
     }
 
@@ -8728,7 +8980,7 @@ private:
             return;
         }
         if (on_pingresp()) {
-            on_mqtt_message_processed(force_move(session_life_keeper));
+            mqtt_message_processed(force_move(session_life_keeper));
         }
         if (pingresp_timeout_ != std::chrono::steady_clock::duration::zero()) tim_pingresp_.cancel();
     }
@@ -8846,7 +9098,7 @@ private:
                 BOOST_ASSERT(false);
             }
             shutdown(*socket_);
-            on_mqtt_message_processed(force_move(session_life_keeper));
+            mqtt_message_processed(force_move(session_life_keeper));
             break;
         }
     }
@@ -8954,7 +9206,7 @@ private:
         case auth_phase::finish:
             BOOST_ASSERT(version_ == protocol_version::v5);
             if (on_v5_auth(info.reason_code, force_move(info.props))) {
-                on_mqtt_message_processed(force_move(session_life_keeper));
+                mqtt_message_processed(force_move(session_life_keeper));
             }
             break;
         }
@@ -9065,6 +9317,7 @@ private:
                         force_move(store_msg),
                         force_move(life_keeper)
                     );
+                    counters_.set_store_size(store_.size());
                     (this->*serialize_publish)(msg);
                 }
                 do_sync_write(force_move(msg));
@@ -9159,6 +9412,7 @@ private:
                         msg,
                         force_move(life_keeper)
                     );
+                    counters_.set_store_size(store_.size());
                     // publish store is erased when pubrec is received.
                     // pubrel store is erased when pubcomp is received.
                     // If invalid client send pubrec twice with the same packet id,
@@ -9228,6 +9482,7 @@ private:
                         msg,
                         force_move(life_keeper)
                     );
+                    counters_.set_store_size(store_.size());
                     (void)ret;
                     BOOST_ASSERT(ret.second);
                 }
@@ -9283,6 +9538,7 @@ private:
             LockGuard<Mutex> lck (sub_unsub_inflight_mtx_);
             sub_unsub_inflight_.insert(packet_id);
         }
+        on_subscribe_sending(params);
         for(auto const& p : params)
         {
             (void)p;
@@ -9332,6 +9588,7 @@ private:
             LockGuard<Mutex> lck (sub_unsub_inflight_mtx_);
             sub_unsub_inflight_.insert(packet_id);
         }
+        on_unsubscribe_sending(params);
         switch (version_) {
         case protocol_version::v3_1_1:
             do_sync_write(v3_1_1::basic_unsubscribe_message<PacketIdBytes>(force_move(params), packet_id));
@@ -9445,10 +9702,45 @@ private:
 
     void send_store() {
         LockGuard<Mutex> lck (store_mtx_);
+        resend_queue_.clear();
+        std::size_t sent = 0;
         auto const& idx = store_.template get<tag_seq>();
         for (auto const& e : idx) {
+            if (resend_window_ != 0 && sent == resend_window_) {
+                resend_queue_.push_back(get_basic_message_variant<PacketIdBytes>(e.message()));
+                continue;
+            }
             do_sync_write(get_basic_message_variant<PacketIdBytes>(e.message()));
+            ++sent;
+        }
+    }
+
+    // Send the next stored message that is held back by the resend window.
+    // It is called when a resent message is acknowledged.
+    void resend_next() {
+        optional<basic_message_variant<PacketIdBytes>> mv;
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            if (resend_queue_.empty()) return;
+            mv.emplace(force_move(resend_queue_.front()));
+            resend_queue_.pop_front();
+        }
+        if (async_send_store_) {
+            do_async_write(force_move(mv.value()), [](error_code) {});
+        }
+        else {
+            do_sync_write(force_move(mv.value()));
+        }
+    }
+
+    void flush_offline_publishes() {
+        std::deque<std::function<void()>> publishes;
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            publishes = force_move(offline_publishes_);
+            offline_publishes_.clear();
         }
+        for (auto& p : publishes) p();
     }
 
     // Blocking write
@@ -9457,7 +9749,20 @@ private:
         boost::system::error_code ec;
         if (!connected_) return;
         on_pre_send();
-        total_bytes_sent_ += socket_->write(const_buffer_sequence<PacketIdBytes>(mv), ec);
+        // Keep the (possibly converted) message alive while cbs refers to it.
+        basic_message_variant<PacketIdBytes> const& v = mv;
+        auto cbs = const_buffer_sequence<PacketIdBytes>(v);
+        auto type = packet_type_of(cbs);
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        auto write_started_at = std::chrono::steady_clock::now();
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+        counters_.add_bytes_sent(socket_->write(force_move(cbs), ec));
+        if (!ec) {
+            counters_.packet_sent(type);
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+            counters_.send_latency().record(std::chrono::steady_clock::now() - write_started_at);
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+        }
         // If ec is set as error, the error will be handled by async_read.
         // If `handle_error(ec);` is called here, error_handler would be called twice.
     }
@@ -9552,6 +9857,51 @@ private:
         any life_keeper,
         async_handler_t func
     ) {
+        if (offline_publish_limit_ != 0 && !mqtt_connected_) {
+            bool queued = false;
+            {
+                LockGuard<Mutex> lck (store_mtx_);
+                if (offline_publishes_.size() < offline_publish_limit_) {
+                    offline_publishes_.emplace_back(
+                        [
+                            this,
+                            packet_id,
+                            topic_name,
+                            payloads = force_move(payloads),
+                            pubopts,
+                            props = force_move(props),
+                            life_keeper,
+                            func
+                        ]
+                        () mutable {
+                            if (packet_id != 0) {
+                                // The packet id might be released by the clean session.
+                                LockGuard<Mutex> lck (store_mtx_);
+                                packet_id_.insert(packet_id);
+                            }
+                            async_send_publish(
+                                packet_id,
+                                topic_name,
+                                force_move(payloads),
+                                pubopts,
+                                force_move(props),
+                                force_move(life_keeper),
+                                force_move(func)
+                            );
+                        }
+                    );
+                    queued = true;
+                }
+                else if (packet_id != 0) {
+                    packet_id_.erase(packet_id);
+                }
+            }
+            if (!queued && func) {
+                func(boost::system::errc::make_error_code(boost::system::errc::no_buffer_space));
+            }
+            return;
+        }
+
         auto do_async_send_publish =
             [&](auto msg, auto const& serialize_publish) {
                 if (pubopts.get_qos() == qos::at_least_once || pubopts.get_qos() == qos::exactly_once) {
@@ -9566,6 +9916,7 @@ private:
                             store_msg,
                             life_keeper
                         );
+                        counters_.set_store_size(store_.size());
                         (void)ret;
                         BOOST_ASSERT(ret.second);
                     }
@@ -9692,6 +10043,7 @@ private:
                         msg,
                         life_keeper
                     );
+                    counters_.set_store_size(store_.size());
                     // publish store is erased when pubrec is received.
                     // pubrel store is erased when pubcomp is received.
                     // If invalid client send pubrec twice with the same packet id,
@@ -9789,6 +10141,7 @@ private:
             LockGuard<Mutex> lck (sub_unsub_inflight_mtx_);
             sub_unsub_inflight_.insert(packet_id);
         }
+        on_subscribe_sending(params);
         switch (version_) {
         case protocol_version::v3_1_1:
             do_async_write(
@@ -9853,6 +10206,7 @@ private:
             LockGuard<Mutex> lck (sub_unsub_inflight_mtx_);
             sub_unsub_inflight_.insert(packet_id);
         }
+        on_unsubscribe_sending(params);
         switch (version_) {
         case protocol_version::v3_1_1:
             do_async_write(
@@ -9997,14 +10351,21 @@ private:
             }
         );
         LockGuard<Mutex> lck (store_mtx_);
+        resend_queue_.clear();
+        std::size_t sent = 0;
         auto const& idx = store_.template get<tag_seq>();
         for (auto const& e : idx) {
+            if (resend_window_ != 0 && sent == resend_window_) {
+                resend_queue_.push_back(get_basic_message_variant<PacketIdBytes>(e.message()));
+                continue;
+            }
             do_async_write(
                 get_basic_message_variant<PacketIdBytes>(e.message()),
                 [g]
                 (error_code /*ec*/) {
                 }
             );
+            ++sent;
         }
     }
 
@@ -10014,9 +10375,15 @@ private:
     public:
         async_packet(
             basic_message_variant<PacketIdBytes> mv,
-            async_handler_t h = {})
+            async_handler_t h = {},
+            std::size_t size = 0)
             : mv_(force_move(mv))
-            , handler_(force_move(h)) {}
+            , handler_(force_move(h))
+            , size_(size)
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+            , enqueued_at_(std::chrono::steady_clock::now())
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+        {}
         basic_message_variant<PacketIdBytes> const& message() const {
             return mv_;
         }
@@ -10025,9 +10392,24 @@ private:
         }
         async_handler_t const& handler() const { return handler_; }
         async_handler_t& handler() { return handler_; }
+        std::size_t size() const { return size_; }
+        control_packet_type type() const { return type_; }
+        void set_type(control_packet_type type) { type_ = type; }
+        // The next packet in the queue belongs to the same batch
+        bool batch_continued() const { return batch_continued_; }
+        void set_batch_continued() { batch_continued_ = true; }
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        std::chrono::steady_clock::time_point enqueued_at() const { return enqueued_at_; }
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
     private:
         basic_message_variant<PacketIdBytes> mv_;
         async_handler_t handler_;
+        std::size_t size_;
+        control_packet_type type_ = control_packet_type::connect;
+        bool batch_continued_ = false;
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        std::chrono::steady_clock::time_point enqueued_at_;
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
     };
 
     struct write_completion_handler {
@@ -10050,7 +10432,7 @@ private:
         void operator()(error_code ec) const {
             func_(ec);
             for (std::size_t i = 0; i != num_of_messages_; ++i) {
-                self_->queue_.pop_front();
+                self_->queue_pop_front(!ec);
             }
             if (ec || // Error is handled by async_read.
                 !self_->connected_) {
@@ -10058,7 +10440,7 @@ private:
                 while (!self_->queue_.empty()) {
                     // Handlers for outgoing packets need not be valid.
                     if(auto&& h = self_->queue_.front().handler()) h(ec);
-                    self_->queue_.pop_front();
+                    self_->queue_pop_front(false);
                 }
                 return;
             }
@@ -10070,9 +10452,9 @@ private:
             error_code ec,
             std::size_t bytes_transferred) const {
             func_(ec);
-            self_->total_bytes_sent_ += bytes_transferred;
+            self_->counters_.add_bytes_sent(bytes_transferred);
             for (std::size_t i = 0; i != num_of_messages_; ++i) {
-                self_->queue_.pop_front();
+                self_->queue_pop_front(!ec && bytes_to_transfer_ == bytes_transferred);
             }
             if (ec || // Error is handled by async_read.
                 !self_->connected_) {
@@ -10080,7 +10462,7 @@ private:
                 while (!self_->queue_.empty()) {
                     // Handlers for outgoing packets need not be valid.
                     if(auto&& h = self_->queue_.front().handler()) h(ec);
-                    self_->queue_.pop_front();
+                    self_->queue_pop_front(false);
                 }
                 return;
             }
@@ -10089,7 +10471,7 @@ private:
                 while (!self_->queue_.empty()) {
                     // Handlers for outgoing packets need not be valid.
                     if(auto&& h = self_->queue_.front().handler()) h(ec);
-                    self_->queue_.pop_front();
+                    self_->queue_pop_front(false);
                 }
                 throw write_bytes_transferred_error(bytes_to_transfer_, bytes_transferred);
             }
@@ -10103,29 +10485,43 @@ private:
         std::size_t bytes_to_transfer_;
     };
 
+    static control_packet_type packet_type_of(std::vector<as::const_buffer> const& cbs) {
+        // The first buffer of the sequence always starts with the fixed header.
+        BOOST_ASSERT(!cbs.empty() && cbs.front().size() != 0);
+        return get_control_packet_type(*static_cast<std::uint8_t const*>(cbs.front().data()));
+    }
+
+    void queue_pop_front(bool sent) {
+        auto const& elem = queue_.front();
+        if (sent) {
+            counters_.packet_sent(elem.type());
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+            counters_.send_latency().record(std::chrono::steady_clock::now() - elem.enqueued_at());
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+        }
+        counters_.dequeued(elem.size());
+        queue_.pop_front();
+    }
+
     void do_async_write() {
-        // Only attempt to send up to the user specified maximum items
         using difference_t = typename decltype(queue_)::difference_type;
-        std::size_t iterator_count =   (max_queue_send_count_ == 0)
-                                ? queue_.size()
-                                : std::min(max_queue_send_count_, queue_.size());
-        auto const& start = queue_.cbegin();
-        auto end = std::next(start, boost::numeric_cast<difference_t>(iterator_count));
-
-        // And further, only up to the specified maximum bytes
+        std::size_t iterator_count = 0;
         std::size_t total_bytes = 0;
         std::size_t total_const_buffer_sequence = 0;
-        for (auto it = start; it != end; ++it) {
-            auto const& elem = *it;
+        bool in_batch = false;
+        for (auto const& elem : queue_) {
             auto const& mv = elem.message();
             std::size_t const size = MQTT_NS::size<PacketIdBytes>(mv);
 
-            // If we hit the byte limit, we don't include this buffer for this send.
-            if (max_queue_send_size_ != 0 && max_queue_send_size_ < total_bytes + size) {
-                end = it;
-                iterator_count = boost::numeric_cast<std::size_t>(std::distance(start, end));
-                break;
+            // The packets of a batch are always sent by one write.
+            if (!in_batch) {
+                // Only attempt to send up to the user specified maximum items
+                if (max_queue_send_count_ != 0 && iterator_count == max_queue_send_count_) break;
+                // And further, only up to the specified maximum bytes
+                if (max_queue_send_size_ != 0 && max_queue_send_size_ < total_bytes + size) break;
             }
+            in_batch = elem.batch_continued();
+            ++iterator_count;
             total_bytes += size;
             total_const_buffer_sequence += num_of_const_buffer_sequence(mv);
         }
@@ -10136,10 +10532,11 @@ private:
         buf.reserve(total_const_buffer_sequence);
         handlers.reserve(iterator_count);
 
-        for (auto it = start; it != end; ++it) {
-            auto const& elem = *it;
+        for (auto it = queue_.begin(), e = std::next(it, boost::numeric_cast<difference_t>(iterator_count)); it != e; ++it) {
+            auto& elem = *it;
             auto const& mv = elem.message();
             auto const& cbs = const_buffer_sequence(mv);
+            elem.set_type(packet_type_of(cbs));
             std::copy(cbs.begin(), cbs.end(), std::back_inserter(buf));
             handlers.emplace_back(elem.handler());
         }
@@ -10172,7 +10569,9 @@ private:
                     if (func) func(boost::system::errc::make_error_code(boost::system::errc::success));
                     return;
                 }
-                queue_.emplace_back(force_move(mv), force_move(func));
+                auto size = MQTT_NS::size<PacketIdBytes>(mv);
+                counters_.enqueued(size, !queue_.empty());
+                queue_.emplace_back(force_move(mv), force_move(func), size);
                 // Only need to start async writes if there was nothing in the queue before the above item.
                 if (queue_.size() > 1) return;
                 do_async_write();
@@ -10180,6 +10579,35 @@ private:
         );
     }
 
+    void do_async_write(std::vector<basic_message_variant<PacketIdBytes>> mvs, async_handler_t func) {
+        // Move the whole batch to the socket's strand by one post.
+        socket_->post(
+            [this, self = this->shared_from_this(), mvs = force_move(mvs), func = force_move(func)]
+            () mutable {
+                if (!connected_ || mvs.empty()) {
+                    // offline async publish is successfully finished, because there's nothing to do.
+                    if (func) func(boost::system::errc::make_error_code(boost::system::errc::success));
+                    return;
+                }
+                bool idle = queue_.empty();
+                for (std::size_t i = 0; i != mvs.size(); ++i) {
+                    auto size = MQTT_NS::size<PacketIdBytes>(mvs[i]);
+                    counters_.enqueued(size, !idle);
+                    if (i + 1 == mvs.size()) {
+                        // The completion handler is called once when the whole batch is written.
+                        queue_.emplace_back(force_move(mvs[i]), force_move(func), size);
+                    }
+                    else {
+                        queue_.emplace_back(force_move(mvs[i]), async_handler_t(), size);
+                        queue_.back().set_batch_continued();
+                    }
+                }
+                if (!idle) return;
+                do_async_write();
+            }
+        );
+    }
+
     static constexpr std::uint16_t make_uint16_t(char b1, char b2) {
         return
             static_cast<std::uint16_t>(
@@ -10258,7 +10686,7 @@ protected:
     bool clean_session_{false};
 
 private:
-    optional<MQTT_NS::socket> socket_;
+    optional<Socket> socket_;
     std::atomic<bool> connected_{false};
     std::atomic<bool> mqtt_connected_{false};
 
@@ -10284,11 +10712,18 @@ private:
     bool connect_requested_{false};
     std::size_t max_queue_send_count_{1};
     std::size_t max_queue_send_size_{0};
+    std::size_t resend_window_{0};
+    std::deque<basic_message_variant<PacketIdBytes>> resend_queue_;
+    std::size_t offline_publish_limit_{0};
+    std::deque<std::function<void()>> offline_publishes_;
     protocol_version version_{protocol_version::undetermined};
     std::size_t packet_bulk_read_limit_ = 256;
     std::size_t props_bulk_read_limit_ = packet_bulk_read_limit_;
-    std::size_t total_bytes_sent_ = 0;
-    std::size_t total_bytes_received_ = 0;
+    endpoint_counters counters_;
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+    std::chrono::steady_clock::time_point read_completed_at_;
+    std::chrono::steady_clock::time_point dispatched_at_;
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
     static constexpr std::uint8_t variable_length_continue_flag = 0b10000000;
 
     std::chrono::steady_clock::duration pingresp_timeout_ = std::chrono::steady_clock::duration::zero();
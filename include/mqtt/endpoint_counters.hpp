@@ -0,0 +1,348 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_ENDPOINT_COUNTERS_HPP)
+#define MQTT_ENDPOINT_COUNTERS_HPP
+
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <unordered_set>
+
+#include <boost/assert.hpp>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/control_packet_type.hpp>
+
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+#include <mqtt/latency_histogram.hpp>
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+
+namespace MQTT_NS {
+
+class endpoint_counters_group;
+
+/**
+ * @brief Lock-free performance counters of an endpoint.
+ *
+ * All counters are updated with relaxed atomic operations by the endpoint only,
+ * so they can be read from any thread (e.g. a monitoring thread) while the
+ * endpoint is running. Aggregation over many endpoints is done on read by
+ * endpoint_counters_group.
+ * If MQTT_USE_LATENCY_HISTOGRAM is defined, latency histograms of packet
+ * processing stages are also recorded.
+ */
+class endpoint_counters {
+public:
+    using value_type = std::size_t;
+
+    /**
+     * @brief Number of slots of packet type indexed arrays.
+     * The index is control_packet_type >> 4. Index 0 is reserved.
+     */
+    static constexpr std::size_t packet_type_slots = 16;
+
+    /**
+     * @brief Plain copy of the counters.
+     */
+    struct snapshot {
+        std::array<value_type, packet_type_slots> packets_sent{};
+        std::array<value_type, packet_type_slots> packets_received{};
+        value_type bytes_sent = 0;
+        value_type bytes_received = 0;
+        value_type queue_depth = 0;
+        value_type queue_bytes = 0;
+        value_type peak_queue_depth = 0;
+        value_type store_size = 0;
+        value_type write_stalls = 0;
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        latency_histogram::snapshot receive_latency;
+        latency_histogram::snapshot process_latency;
+        latency_histogram::snapshot send_latency;
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+
+        value_type sent(control_packet_type type) const {
+            return packets_sent[index(type)];
+        }
+        value_type received(control_packet_type type) const {
+            return packets_received[index(type)];
+        }
+        value_type total_packets_sent() const {
+            value_type sum = 0;
+            for (auto v : packets_sent) sum += v;
+            return sum;
+        }
+        value_type total_packets_received() const {
+            value_type sum = 0;
+            for (auto v : packets_received) sum += v;
+            return sum;
+        }
+    };
+
+    endpoint_counters() = default;
+    endpoint_counters(endpoint_counters const&) = delete;
+    endpoint_counters& operator=(endpoint_counters const&) = delete;
+    inline ~endpoint_counters();
+
+    /**
+     * @brief Record a sent packet.
+     *        Call it after the packet is successfully written.
+     * @param type control packet type
+     */
+    void packet_sent(control_packet_type type) {
+        add(packets_sent_[index(type)], 1);
+    }
+
+    /**
+     * @brief Record a received packet.
+     * @param type  control packet type
+     * @param bytes size of the packet including the fixed header
+     */
+    void packet_received(control_packet_type type, value_type bytes) {
+        add(packets_received_[index(type)], 1);
+        add(bytes_received_, bytes);
+    }
+
+    void add_bytes_sent(value_type bytes) {
+        add(bytes_sent_, bytes);
+    }
+
+    /**
+     * @brief Record that a message is pushed to the send queue.
+     * @param bytes    size of the message
+     * @param stalled  true if the message needs to wait for the preceding write
+     */
+    void enqueued(value_type bytes, bool stalled) {
+        auto depth = add(queue_depth_, 1) + 1;
+        add(queue_bytes_, bytes);
+        update_peak(depth);
+        if (stalled) add(write_stalls_, 1);
+    }
+
+    /**
+     * @brief Record that a message is popped from the send queue.
+     * @param bytes size of the message
+     */
+    void dequeued(value_type bytes) {
+        sub(queue_depth_, 1);
+        sub(queue_bytes_, bytes);
+    }
+
+    /**
+     * @brief Update the number of stored (inflight) messages.
+     * @param size current size of the store
+     */
+    void set_store_size(value_type size) {
+        store_size_.store(size, std::memory_order_relaxed);
+    }
+
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+    /**
+     * @brief Latency from the first byte of a packet is read to the packet type dispatch.
+     */
+    latency_histogram& receive_latency() { return receive_latency_; }
+    latency_histogram const& receive_latency() const { return receive_latency_; }
+
+    /**
+     * @brief Latency from the packet type dispatch to the return of the handler.
+     */
+    latency_histogram& process_latency() { return process_latency_; }
+    latency_histogram const& process_latency() const { return process_latency_; }
+
+    /**
+     * @brief Latency from a message is enqueued to its write completion.
+     *        It includes the waiting time in the send queue.
+     *        For a synchronous write, it is the duration of the write.
+     */
+    latency_histogram& send_latency() { return send_latency_; }
+    latency_histogram const& send_latency() const { return send_latency_; }
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+
+    value_type packets_sent(control_packet_type type) const {
+        return load(packets_sent_[index(type)]);
+    }
+    value_type packets_received(control_packet_type type) const {
+        return load(packets_received_[index(type)]);
+    }
+    value_type bytes_sent() const { return load(bytes_sent_); }
+    value_type bytes_received() const { return load(bytes_received_); }
+    value_type queue_depth() const { return load(queue_depth_); }
+    value_type queue_bytes() const { return load(queue_bytes_); }
+    value_type peak_queue_depth() const { return load(peak_queue_depth_); }
+    value_type store_size() const { return load(store_size_); }
+    value_type write_stalls() const { return load(write_stalls_); }
+
+    /**
+     * @brief Get a copy of all counters.
+     *        Each value is read atomically, the set of values is not a consistent cut.
+     * @return snapshot
+     */
+    snapshot get_snapshot() const {
+        snapshot s;
+        for (std::size_t i = 0; i != packet_type_slots; ++i) {
+            s.packets_sent[i] = load(packets_sent_[i]);
+            s.packets_received[i] = load(packets_received_[i]);
+        }
+        s.bytes_sent = load(bytes_sent_);
+        s.bytes_received = load(bytes_received_);
+        s.queue_depth = load(queue_depth_);
+        s.queue_bytes = load(queue_bytes_);
+        s.peak_queue_depth = load(peak_queue_depth_);
+        s.store_size = load(store_size_);
+        s.write_stalls = load(write_stalls_);
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        s.receive_latency = receive_latency_.get_snapshot();
+        s.process_latency = process_latency_.get_snapshot();
+        s.send_latency = send_latency_.get_snapshot();
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+        return s;
+    }
+
+    /**
+     * @brief Reset the peak queue depth to the current queue depth.
+     *        Useful for interval based monitoring.
+     */
+    void reset_peak_queue_depth() {
+        peak_queue_depth_.store(load(queue_depth_), std::memory_order_relaxed);
+    }
+
+    static constexpr std::size_t index(control_packet_type type) {
+        return static_cast<std::size_t>(type) >> 4;
+    }
+
+private:
+    friend class endpoint_counters_group;
+
+    using counter_t = std::atomic<value_type>;
+
+    static value_type add(counter_t& c, value_type v) {
+        return c.fetch_add(v, std::memory_order_relaxed);
+    }
+    static value_type sub(counter_t& c, value_type v) {
+        return c.fetch_sub(v, std::memory_order_relaxed);
+    }
+    static value_type load(counter_t const& c) {
+        return c.load(std::memory_order_relaxed);
+    }
+
+    void update_peak(value_type depth) {
+        auto peak = load(peak_queue_depth_);
+        while (peak < depth &&
+               !peak_queue_depth_.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::array<counter_t, packet_type_slots> packets_sent_{};
+    std::array<counter_t, packet_type_slots> packets_received_{};
+    counter_t bytes_sent_{0};
+    counter_t bytes_received_{0};
+    counter_t queue_depth_{0};
+    counter_t queue_bytes_{0};
+    counter_t peak_queue_depth_{0};
+    counter_t store_size_{0};
+    counter_t write_stalls_{0};
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+    latency_histogram receive_latency_;
+    latency_histogram process_latency_;
+    latency_histogram send_latency_;
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+    std::shared_ptr<endpoint_counters_group> group_;
+};
+
+/**
+ * @brief Registry of endpoint_counters that aggregates them on read.
+ *
+ * Endpoints never write to the group, so registering an endpoint adds no cost
+ * to its hot path. get_snapshot() sums the live endpoints and the cumulative
+ * counters (packets, bytes, and write stalls) of already destroyed endpoints.
+ */
+class endpoint_counters_group : public std::enable_shared_from_this<endpoint_counters_group> {
+public:
+    /**
+     * @brief Register counters to the group.
+     *        The counters are unregistered automatically when they are destroyed.
+     * @param c counters to register. Must not be registered to another group.
+     */
+    void add(endpoint_counters& c) {
+        BOOST_ASSERT(!c.group_);
+        std::lock_guard<std::mutex> g(mtx_);
+        members_.insert(&c);
+        c.group_ = this->shared_from_this();
+    }
+
+    /**
+     * @brief Get the number of registered (live) counters.
+     * @return number of counters
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> g(mtx_);
+        return members_.size();
+    }
+
+    /**
+     * @brief Get the sum of all counters.
+     *        peak_queue_depth is the maximum of the live counters.
+     *        Latency histograms are merged.
+     * @return snapshot
+     */
+    endpoint_counters::snapshot get_snapshot() const {
+        std::lock_guard<std::mutex> g(mtx_);
+        auto s = base_;
+        for (auto c : members_) {
+            accumulate(s, c->get_snapshot(), true);
+        }
+        return s;
+    }
+
+private:
+    friend class endpoint_counters;
+
+    void remove(endpoint_counters const& c) {
+        auto s = c.get_snapshot();
+        std::lock_guard<std::mutex> g(mtx_);
+        members_.erase(&c);
+        accumulate(base_, s, false);
+    }
+
+    static void accumulate(
+        endpoint_counters::snapshot& to,
+        endpoint_counters::snapshot const& from,
+        bool with_gauges) {
+        for (std::size_t i = 0; i != endpoint_counters::packet_type_slots; ++i) {
+            to.packets_sent[i] += from.packets_sent[i];
+            to.packets_received[i] += from.packets_received[i];
+        }
+        to.bytes_sent += from.bytes_sent;
+        to.bytes_received += from.bytes_received;
+        to.write_stalls += from.write_stalls;
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+        to.receive_latency += from.receive_latency;
+        to.process_latency += from.process_latency;
+        to.send_latency += from.send_latency;
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+        if (with_gauges) {
+            to.queue_depth += from.queue_depth;
+            to.queue_bytes += from.queue_bytes;
+            to.store_size += from.store_size;
+            to.peak_queue_depth = std::max(to.peak_queue_depth, from.peak_queue_depth);
+        }
+    }
+
+    mutable std::mutex mtx_;
+    std::unordered_set<endpoint_counters const*> members_;
+    endpoint_counters::snapshot base_;
+};
+
+inline endpoint_counters::~endpoint_counters() {
+    if (group_) group_->remove(*this);
+}
+
+} // namespace MQTT_NS
+
+#endif // MQTT_ENDPOINT_COUNTERS_HPP
@@ -118,6 +118,12 @@ struct restore_type_error : std::exception {
     }
 };
 
+struct store_file_error : std::exception {
+    char const* what() const noexcept override final {
+        return "store file error";
+    }
+};
+
 } // namespace MQTT_NS
 
 #endif // MQTT_EXCEPTION_HPP
@@ -0,0 +1,168 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_LATENCY_HISTOGRAM_HPP)
+#define MQTT_LATENCY_HISTOGRAM_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <algorithm>
+
+#include <mqtt/namespace.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Lock-free latency histogram with log-linear buckets (HDR histogram style).
+ *
+ * Values are recorded in nanoseconds. Each power of two range is divided into
+ * sub_bucket_count linear buckets, so the relative error of a recorded value is
+ * at most 1 / sub_bucket_count. Values greater than or equal to 2^max_magnitude
+ * nanoseconds are counted in the last bucket.
+ */
+class latency_histogram {
+public:
+    using value_type = std::uint64_t;
+
+    static constexpr std::size_t sub_bucket_bits = 3;
+    static constexpr std::size_t sub_bucket_count = std::size_t(1) << sub_bucket_bits;
+    static constexpr std::size_t max_magnitude = 40; // about 18 minutes
+    static constexpr std::size_t bucket_count = (max_magnitude - sub_bucket_bits + 1) * sub_bucket_count;
+
+    /**
+     * @brief Plain copy of the histogram.
+     */
+    struct snapshot {
+        std::array<value_type, bucket_count> counts{};
+        value_type count = 0;
+        value_type sum = 0;
+        value_type max = 0;
+
+        /**
+         * @brief Get the mean value.
+         * @return mean value in nanoseconds. 0 if no value is recorded.
+         */
+        value_type mean() const {
+            return count == 0 ? 0 : sum / count;
+        }
+
+        /**
+         * @brief Get the value at the percentile.
+         * @param percentile 0.0 to 100.0
+         * @return the highest value that is equivalent to the recorded value at the percentile.
+         *         0 if no value is recorded.
+         */
+        value_type percentile(double percentile) const {
+            if (count == 0) return 0;
+            auto p = std::min(std::max(percentile, 0.0), 100.0);
+            auto target = static_cast<value_type>(static_cast<double>(count) * p / 100.0 + 0.5);
+            if (target == 0) target = 1;
+            value_type cumulative = 0;
+            for (std::size_t i = 0; i != bucket_count; ++i) {
+                cumulative += counts[i];
+                if (cumulative >= target) return std::min(bucket_upper(i), max);
+            }
+            return max;
+        }
+
+        snapshot& operator+=(snapshot const& other) {
+            for (std::size_t i = 0; i != bucket_count; ++i) {
+                counts[i] += other.counts[i];
+            }
+            count += other.count;
+            sum += other.sum;
+            max = std::max(max, other.max);
+            return *this;
+        }
+    };
+
+    latency_histogram() = default;
+    latency_histogram(latency_histogram const&) = delete;
+    latency_histogram& operator=(latency_histogram const&) = delete;
+
+    /**
+     * @brief Record a value.
+     * @param ns value in nanoseconds
+     */
+    void record(value_type ns) {
+        counts_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+        auto m = max_.load(std::memory_order_relaxed);
+        while (m < ns &&
+               !max_.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief Record a duration.
+     * @param d duration. Negative duration is recorded as 0.
+     */
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        record(ns < 0 ? value_type(0) : static_cast<value_type>(ns));
+    }
+
+    /**
+     * @brief Get a copy of the histogram.
+     *        Each value is read atomically, the set of values is not a consistent cut.
+     * @return snapshot
+     */
+    snapshot get_snapshot() const {
+        snapshot s;
+        for (std::size_t i = 0; i != bucket_count; ++i) {
+            s.counts[i] = counts_[i].load(std::memory_order_relaxed);
+        }
+        s.count = count_.load(std::memory_order_relaxed);
+        s.sum = sum_.load(std::memory_order_relaxed);
+        s.max = max_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    static std::size_t bucket_index(value_type v) {
+        if (v < sub_bucket_count) return static_cast<std::size_t>(v);
+        auto msb = most_significant_bit(v);
+        if (msb >= max_magnitude) return bucket_count - 1;
+        auto shift = msb - sub_bucket_bits;
+        return (shift + 1) * sub_bucket_count + static_cast<std::size_t>((v >> shift) - sub_bucket_count);
+    }
+
+    static value_type bucket_lower(std::size_t index) {
+        if (index < sub_bucket_count) return index;
+        auto shift = index / sub_bucket_count - 1;
+        return value_type(index % sub_bucket_count + sub_bucket_count) << shift;
+    }
+
+    static value_type bucket_upper(std::size_t index) {
+        if (index < sub_bucket_count) return index;
+        auto shift = index / sub_bucket_count - 1;
+        return bucket_lower(index) + (value_type(1) << shift) - 1;
+    }
+
+private:
+    static std::size_t most_significant_bit(value_type v) {
+#if defined(__GNUC__)
+        return static_cast<std::size_t>(63 - __builtin_clzll(v));
+#else  // defined(__GNUC__)
+        std::size_t msb = 0;
+        while (v >>= 1) ++msb;
+        return msb;
+#endif // defined(__GNUC__)
+    }
+
+    std::array<std::atomic<value_type>, bucket_count> counts_{};
+    std::atomic<value_type> count_{0};
+    std::atomic<value_type> sum_{0};
+    std::atomic<value_type> max_{0};
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_LATENCY_HISTOGRAM_HPP
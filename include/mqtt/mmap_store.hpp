@@ -0,0 +1,496 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_MMAP_STORE_HPP)
+#define MQTT_MMAP_STORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <algorithm>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/buffer.hpp>
+#include <mqtt/message.hpp>
+#include <mqtt/v5_message.hpp>
+#include <mqtt/packet_id_type.hpp>
+#include <mqtt/exception.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+namespace as = boost::asio;
+
+/**
+ * @brief Persistent store of the client side QoS1 and QoS2 messages on a memory-mapped ring file.
+ *
+ * The store is connected to the endpoint's serialize handlers by attach().
+ * Each stored publish or pubrel message is appended to the ring as a record, and the record is
+ * marked as removed when the message is acknowledged. The in-memory index from packet id to
+ * the record position is rebuilt by scanning the ring when the file is opened, so the stored
+ * messages can be restored into the endpoint after the process is restarted.
+ *
+ * The record is written before the tail position in the file header is updated, so a record
+ * that is torn by a crash is ignored when the file is opened.
+ * If the ring is full, live records are compacted and the file is enlarged if required.
+ *
+ * The file format uses the native byte order, so the file can't be shared between
+ * platforms that have different byte order.
+ * The store must outlive the attached endpoint.
+ *
+ * @tparam PacketIdBytes packet id bytes of the endpoint. 2 or 4.
+ */
+template <std::size_t PacketIdBytes = 2>
+class mmap_store {
+public:
+    using packet_id_t = typename packet_id_type<PacketIdBytes>::type;
+
+    /**
+     * @brief Open or create the store file.
+     * @param path file path
+     * @param capacity initial capacity of the ring in bytes. It is used only when the file is created.
+     */
+    mmap_store(std::string path, std::size_t capacity = 1024 * 1024)
+        :path_(force_move(path)) {
+        std::ifstream ifs(path_, std::ios::binary | std::ios::ate);
+        if (ifs && static_cast<std::uint64_t>(ifs.tellg()) >= header_size) {
+            ifs.close();
+            open();
+        }
+        else {
+            ifs.close();
+            create(align(std::max(static_cast<std::uint64_t>(capacity), std::uint64_t(record_header_size))));
+        }
+    }
+
+    mmap_store(mmap_store const&) = delete;
+    mmap_store& operator=(mmap_store const&) = delete;
+
+    ~mmap_store() {
+        sync();
+    }
+
+    /**
+     * @brief Set the sync interval.
+     *        The file is synchronized to the storage after the number of updates.
+     *        If the value is 1, each update is written through to the storage.
+     *        If the value is 0, the file is synchronized only by sync() and the destructor.
+     *        The updated data survives the process crash even if it is not synchronized,
+     *        but it could be lost by the system crash.
+     *        The default value is 0.
+     * @param interval number of updates between synchronizations
+     */
+    void set_sync_interval(std::size_t interval) {
+        std::lock_guard<std::mutex> g(mtx_);
+        sync_interval_ = interval;
+    }
+
+    /**
+     * @brief Synchronize the file to the storage.
+     */
+    void sync() {
+        std::lock_guard<std::mutex> g(mtx_);
+        region_.flush(0, 0, false);
+        unsynced_ = 0;
+    }
+
+    /**
+     * @brief Get the number of stored messages
+     * @return the number of stored messages
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> g(mtx_);
+        return index_.size();
+    }
+
+    /**
+     * @brief Get the capacity of the ring
+     * @return capacity in bytes
+     */
+    std::size_t capacity() const {
+        std::lock_guard<std::mutex> g(mtx_);
+        return static_cast<std::size_t>(capacity_);
+    }
+
+    /**
+     * @brief Restore the stored messages into the endpoint and set the serialize handlers.
+     *        This function should be called before connect.
+     * @param ep endpoint. callable_overlay of client.
+     */
+    template <typename Endpoint>
+    void attach(Endpoint& ep) {
+        restore(ep);
+        auto h_remove =
+            [this](packet_id_t packet_id) {
+                remove(packet_id);
+            };
+        ep.set_serialize_handlers(
+            [this](basic_publish_message<PacketIdBytes> msg) {
+                append(record_type::publish, msg.packet_id(), msg.const_buffer_sequence());
+            },
+            [this](basic_pubrel_message<PacketIdBytes> msg) {
+                append(record_type::pubrel, msg.packet_id(), msg.const_buffer_sequence());
+            },
+            h_remove
+        );
+        ep.set_v5_serialize_handlers(
+            [this](v5::basic_publish_message<PacketIdBytes> msg) {
+                append(record_type::v5_publish, msg.packet_id(), msg.const_buffer_sequence());
+            },
+            [this](v5::basic_pubrel_message<PacketIdBytes> msg) {
+                append(record_type::v5_pubrel, msg.packet_id(), msg.const_buffer_sequence());
+            },
+            h_remove
+        );
+    }
+
+    /**
+     * @brief Restore the stored messages into the endpoint in the stored order.
+     * @param ep endpoint
+     */
+    template <typename Endpoint>
+    void restore(Endpoint& ep) {
+        std::vector<std::pair<record_type, buffer>> records;
+        {
+            std::lock_guard<std::mutex> g(mtx_);
+            for (auto pos : live_positions()) {
+                auto rh = read_record_header(pos);
+                auto p = record_payload(pos);
+                records.emplace_back(static_cast<record_type>(rh.type), allocate_buffer(p, p + rh.size));
+            }
+        }
+        for (auto& r : records) {
+            // The message refers to the buffer, so the buffer is passed as the life keeper.
+            auto const& buf = r.second;
+            switch (r.first) {
+            case record_type::publish:
+                ep.restore_serialized_message(basic_publish_message<PacketIdBytes>(buf), buf);
+                break;
+            case record_type::pubrel:
+                ep.restore_serialized_message(basic_pubrel_message<PacketIdBytes>(buf), buf);
+                break;
+            case record_type::v5_publish:
+                ep.restore_v5_serialized_message(v5::basic_publish_message<PacketIdBytes>(buf), buf);
+                break;
+            case record_type::v5_pubrel:
+                ep.restore_v5_serialized_message(v5::basic_pubrel_message<PacketIdBytes>(buf), buf);
+                break;
+            default:
+                throw restore_type_error();
+            }
+        }
+    }
+
+private:
+    enum class record_type : std::uint8_t {
+        padding,
+        publish,
+        pubrel,
+        v5_publish,
+        v5_pubrel,
+    };
+
+    struct file_header {
+        char magic[8];
+        std::uint64_t capacity;
+        std::uint64_t head;
+        std::uint64_t tail;
+    };
+
+    struct record_header {
+        std::uint32_t size;
+        std::uint8_t type;
+        std::uint8_t live;
+        std::uint16_t reserved;
+        std::uint32_t packet_id;
+        std::uint32_t checksum;
+    };
+
+    static constexpr std::uint64_t header_size = 64;
+    static constexpr std::uint64_t record_header_size = sizeof(record_header);
+    static constexpr char const* magic = "MQTTRNG1";
+
+    static_assert(sizeof(file_header) <= header_size, "file_header is too big");
+    static_assert(record_header_size == 16, "unexpected record_header size");
+
+    // Records are aligned to the record header size, so a padding record always fits at the end of the ring.
+    static std::uint64_t align(std::uint64_t size) {
+        return (size + record_header_size - 1) / record_header_size * record_header_size;
+    }
+
+    static std::uint32_t fnv1a(std::uint32_t h, char const* p, std::size_t size) {
+        for (std::size_t i = 0; i != size; ++i) {
+            h ^= static_cast<std::uint8_t>(p[i]);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    static std::uint32_t checksum(packet_id_t packet_id, char const* p, std::size_t size) {
+        std::uint32_t pid = packet_id;
+        return fnv1a(fnv1a(2166136261u, reinterpret_cast<char const*>(&pid), sizeof(pid)), p, size);
+    }
+
+    static void extend_file(std::string const& path, std::uint64_t size) {
+        {
+            // create the file if it doesn't exist
+            std::ofstream ofs(path, std::ios::binary | std::ios::app);
+            if (!ofs) throw store_file_error();
+        }
+        std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(static_cast<std::streamoff>(size - 1));
+        fs.put('\0');
+        if (!fs) throw store_file_error();
+    }
+
+    void map() {
+        region_ = boost::interprocess::mapped_region();
+        file_ = boost::interprocess::file_mapping(path_.c_str(), boost::interprocess::read_write);
+        region_ = boost::interprocess::mapped_region(file_, boost::interprocess::read_write);
+        base_ = static_cast<char*>(region_.get_address());
+    }
+
+    void create(std::uint64_t capacity) {
+        extend_file(path_, header_size + capacity);
+        map();
+        capacity_ = capacity;
+        head_ = 0;
+        tail_ = 0;
+        file_header fh;
+        std::memcpy(fh.magic, magic, sizeof(fh.magic));
+        fh.capacity = capacity_;
+        fh.head = head_;
+        fh.tail = tail_;
+        std::memcpy(base_, &fh, sizeof(fh));
+        region_.flush(0, 0, false);
+    }
+
+    void open() {
+        map();
+        file_header fh;
+        std::memcpy(&fh, base_, sizeof(fh));
+        if (std::memcmp(fh.magic, magic, sizeof(fh.magic)) != 0 ||
+            fh.capacity == 0 ||
+            fh.capacity % record_header_size != 0 ||
+            region_.get_size() < header_size + fh.capacity ||
+            fh.head > fh.tail ||
+            fh.tail - fh.head > fh.capacity) {
+            throw store_file_error();
+        }
+        capacity_ = fh.capacity;
+        head_ = fh.head;
+        tail_ = fh.tail;
+        replay();
+    }
+
+    // Rebuild the index from the records between head and tail.
+    void replay() {
+        auto pos = head_;
+        while (pos < tail_) {
+            auto off = pos % capacity_;
+            auto rh = read_record_header(pos);
+            if (static_cast<record_type>(rh.type) == record_type::padding) {
+                if (rh.size != capacity_ - off) break;
+                pos += rh.size;
+                continue;
+            }
+            auto total = align(record_header_size + rh.size);
+            if (off + total > capacity_ ||
+                pos + total > tail_ ||
+                rh.type > static_cast<std::uint8_t>(record_type::v5_pubrel) ||
+                rh.checksum != checksum(static_cast<packet_id_t>(rh.packet_id), record_payload(pos), rh.size)) {
+                break;
+            }
+            if (rh.live) {
+                auto pid = static_cast<packet_id_t>(rh.packet_id);
+                auto it = index_.find(pid);
+                if (it != index_.end()) {
+                    set_dead(it->second);
+                    it->second = pos;
+                }
+                else {
+                    index_.emplace(pid, pos);
+                }
+            }
+            pos += total;
+        }
+        // Drop the torn record if exists.
+        tail_ = pos;
+        advance_head();
+        write_header();
+    }
+
+    template <typename ConstBufferSequence>
+    void append(record_type type, packet_id_t packet_id, ConstBufferSequence const& cbs) {
+        std::lock_guard<std::mutex> g(mtx_);
+        auto size = as::buffer_size(cbs);
+        auto total = align(record_header_size + size);
+
+        auto it = index_.find(packet_id);
+        if (it != index_.end()) {
+            set_dead(it->second);
+            index_.erase(it);
+            advance_head();
+        }
+        reserve(total);
+
+        auto pos = tail_;
+        auto p = record_payload(pos);
+        for (auto const& b : cbs) {
+            std::memcpy(p, b.data(), b.size());
+            p += b.size();
+        }
+        record_header rh {
+            static_cast<std::uint32_t>(size),
+            static_cast<std::uint8_t>(type),
+            1,
+            0,
+            static_cast<std::uint32_t>(packet_id),
+            checksum(packet_id, record_payload(pos), size)
+        };
+        write_record_header(pos, rh);
+        index_.emplace(packet_id, pos);
+        tail_ += total;
+        write_header();
+        updated();
+    }
+
+    void remove(packet_id_t packet_id) {
+        std::lock_guard<std::mutex> g(mtx_);
+        auto it = index_.find(packet_id);
+        if (it == index_.end()) return;
+        set_dead(it->second);
+        index_.erase(it);
+        advance_head();
+        write_header();
+        updated();
+    }
+
+    // Make room for the record of total bytes at the tail.
+    void reserve(std::uint64_t total) {
+        while (true) {
+            auto off = tail_ % capacity_;
+            auto to_end = capacity_ - off;
+            auto required = total <= to_end ? total : to_end + total;
+            if (capacity_ - (tail_ - head_) >= required) {
+                if (total > to_end) {
+                    record_header rh { static_cast<std::uint32_t>(to_end), 0, 0, 0, 0, 0 };
+                    write_record_header(tail_, rh);
+                    tail_ += to_end;
+                }
+                return;
+            }
+            compact(total);
+        }
+    }
+
+    // Move the live records to the beginning of the ring, and enlarge the file
+    // if the ring doesn't have room for the record of total bytes.
+    void compact(std::uint64_t total) {
+        std::vector<char> live;
+        for (auto pos : live_positions()) {
+            auto rh = read_record_header(pos);
+            auto p = base_ + header_size + pos % capacity_;
+            live.insert(live.end(), p, p + align(record_header_size + rh.size));
+        }
+        auto capacity = capacity_;
+        while (capacity < live.size() + total) capacity *= 2;
+        if (capacity != capacity_) {
+            region_ = boost::interprocess::mapped_region();
+            extend_file(path_, header_size + capacity);
+            map();
+            capacity_ = capacity;
+        }
+        std::memcpy(base_ + header_size, live.data(), live.size());
+        index_.clear();
+        std::uint64_t pos = 0;
+        while (pos < live.size()) {
+            auto rh = read_record_header(pos);
+            index_.emplace(static_cast<packet_id_t>(rh.packet_id), pos);
+            pos += align(record_header_size + rh.size);
+        }
+        head_ = 0;
+        tail_ = pos;
+        write_header();
+        // The layout is changed, so synchronize it regardless of the sync interval.
+        region_.flush(0, 0, false);
+        unsynced_ = 0;
+    }
+
+    std::vector<std::uint64_t> live_positions() const {
+        std::vector<std::uint64_t> positions;
+        positions.reserve(index_.size());
+        for (auto const& e : index_) positions.push_back(e.second);
+        std::sort(positions.begin(), positions.end());
+        return positions;
+    }
+
+    void advance_head() {
+        while (head_ < tail_) {
+            auto rh = read_record_header(head_);
+            if (rh.live) break;
+            head_ +=
+                static_cast<record_type>(rh.type) == record_type::padding ? rh.size
+                                                                          : align(record_header_size + rh.size);
+        }
+    }
+
+    void updated() {
+        if (sync_interval_ != 0 && ++unsynced_ >= sync_interval_) {
+            region_.flush(0, 0, false);
+            unsynced_ = 0;
+        }
+    }
+
+    record_header read_record_header(std::uint64_t pos) const {
+        record_header rh;
+        std::memcpy(&rh, base_ + header_size + pos % capacity_, sizeof(rh));
+        return rh;
+    }
+
+    void write_record_header(std::uint64_t pos, record_header const& rh) {
+        std::memcpy(base_ + header_size + pos % capacity_, &rh, sizeof(rh));
+    }
+
+    char* record_payload(std::uint64_t pos) const {
+        return base_ + header_size + pos % capacity_ + record_header_size;
+    }
+
+    void set_dead(std::uint64_t pos) {
+        base_[header_size + pos % capacity_ + offsetof(record_header, live)] = 0;
+    }
+
+    void write_header() {
+        std::memcpy(base_ + offsetof(file_header, capacity), &capacity_, sizeof(capacity_));
+        std::memcpy(base_ + offsetof(file_header, head), &head_, sizeof(head_));
+        std::memcpy(base_ + offsetof(file_header, tail), &tail_, sizeof(tail_));
+    }
+
+    std::string path_;
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    char* base_ = nullptr;
+    std::uint64_t capacity_ = 0;
+    std::uint64_t head_ = 0;
+    std::uint64_t tail_ = 0;
+    std::map<packet_id_t, std::uint64_t> index_;
+    std::size_t sync_interval_ = 0;
+    std::size_t unsynced_ = 0;
+    mutable std::mutex mtx_;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_MMAP_STORE_HPP
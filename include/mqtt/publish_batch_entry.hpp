@@ -0,0 +1,34 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_PUBLISH_BATCH_ENTRY_HPP)
+#define MQTT_PUBLISH_BATCH_ENTRY_HPP
+
+#include <string>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/property_variant.hpp>
+#include <mqtt/publish.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief A message of endpoint::async_publish_batch()
+ */
+struct publish_batch_entry {
+    /// A topic name to publish
+    std::string topic_name;
+    /// The contents to publish
+    std::string contents;
+    /// qos, retain flag, and dup flag
+    publish_options pubopts = {};
+    /// Properties (v5 only)
+    v5::properties props = {};
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_PUBLISH_BATCH_ENTRY_HPP
@@ -14,8 +14,10 @@
 
 #include <mqtt/namespace.hpp>
 #include <mqtt/tcp_endpoint.hpp>
+#include <mqtt/uring_endpoint.hpp>
 
 #include <mqtt/endpoint.hpp>
+#include <mqtt/static_socket.hpp>
 #include <mqtt/null_strand.hpp>
 #include <mqtt/move.hpp>
 #include <mqtt/callable_overlay.hpp>
@@ -24,13 +26,16 @@ namespace MQTT_NS {
 
 namespace as = boost::asio;
 
-template <typename Mutex, template<typename...> class LockGuard, std::size_t PacketIdBytes>
-class server_endpoint : public endpoint<Mutex, LockGuard, PacketIdBytes> {
+template <typename Mutex, template<typename...> class LockGuard, std::size_t PacketIdBytes, typename Socket = MQTT_NS::socket>
+class server_endpoint : public endpoint<Mutex, LockGuard, PacketIdBytes, Socket> {
 public:
-    using endpoint<Mutex, LockGuard, PacketIdBytes>::endpoint;
+    using endpoint<Mutex, LockGuard, PacketIdBytes, Socket>::endpoint;
 protected:
+    bool on_connack(bool, connect_return_code) noexcept override { return true; }
     bool on_v5_connack(bool, v5::connect_reason_code, v5::properties) noexcept override { return true; }
     void on_pre_send() noexcept override {}
+    void on_subscribe_sending(std::vector<std::tuple<as::const_buffer, subscribe_options>> const&) noexcept override {}
+    void on_unsubscribe_sending(std::vector<as::const_buffer> const&) noexcept override {}
     void on_close() noexcept override {}
     void on_error(error_code /*ec*/) noexcept override {}
 protected:
@@ -41,12 +46,13 @@ template <
     typename Strand = as::io_context::strand,
     typename Mutex = std::mutex,
     template<typename...> class LockGuard = std::lock_guard,
-    std::size_t PacketIdBytes = 2
+    std::size_t PacketIdBytes = 2,
+    typename Dispatch = type_erased_dispatch
 >
 class server {
 public:
     using socket_t = tcp_endpoint<as::ip::tcp::socket, Strand>;
-    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes>>;
+    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes, typename Dispatch::template socket_type<socket_t>>>;
 
     /**
      * @brief Accept handler
@@ -193,18 +199,207 @@ private:
     protocol_version version_ = protocol_version::undetermined;
 };
 
+#if defined(MQTT_USE_IO_URING)
+
+/**
+ * @brief TCP server whose connections are driven by io_uring
+ *
+ * Accepting is done by the acceptor on ioc_accept. The accepted connections are uring_endpoint
+ * and share one uring_context that is driven by ioc_con. ioc_con must be run by a single thread,
+ * and ioc_accept must be run by the same thread because the accept handler starts reading.
+ */
+template <
+    typename Strand = as::io_context::strand,
+    typename Mutex = std::mutex,
+    template<typename...> class LockGuard = std::lock_guard,
+    std::size_t PacketIdBytes = 2,
+    typename Dispatch = type_erased_dispatch
+>
+class server_uring {
+public:
+    using socket_t = uring_endpoint<Strand>;
+    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes, typename Dispatch::template socket_type<socket_t>>>;
+
+    /**
+     * @brief Accept handler
+     * @param ep endpoint of the connecting client
+     */
+    using accept_handler = std::function<void(std::shared_ptr<endpoint_t> ep)>;
+
+    /**
+     * @brief Error handler
+     * @param ec error code
+     */
+    using error_handler = std::function<void(error_code ec)>;
+
+    template <typename AsioEndpoint, typename AcceptorConfig>
+    server_uring(
+        AsioEndpoint&& ep,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con,
+        AcceptorConfig&& config)
+        : ep_(std::forward<AsioEndpoint>(ep)),
+          ioc_accept_(ioc_accept),
+          ioc_con_(ioc_con),
+          acceptor_(as::ip::tcp::acceptor(ioc_accept_, ep_)),
+          config_(std::forward<AcceptorConfig>(config)) {
+        config_(acceptor_.value());
+    }
+
+    template <typename AsioEndpoint>
+    server_uring(
+        AsioEndpoint&& ep,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con)
+        : server_uring(std::forward<AsioEndpoint>(ep), ioc_accept, ioc_con, [](as::ip::tcp::acceptor&) {}) {}
+
+    template <typename AsioEndpoint, typename AcceptorConfig>
+    server_uring(
+        AsioEndpoint&& ep,
+        as::io_context& ioc,
+        AcceptorConfig&& config)
+        : server_uring(std::forward<AsioEndpoint>(ep), ioc, ioc, std::forward<AcceptorConfig>(config)) {}
+
+    template <typename AsioEndpoint>
+    server_uring(
+        AsioEndpoint&& ep,
+        as::io_context& ioc)
+        : server_uring(std::forward<AsioEndpoint>(ep), ioc, ioc, [](as::ip::tcp::acceptor&) {}) {}
+
+    void listen() {
+        close_request_ = false;
+
+        try {
+            if (!uring_) uring_ = std::make_shared<uring_context>(ioc_con_, uring_config_);
+            if (!acceptor_) {
+                acceptor_.emplace(ioc_accept_, ep_);
+                config_(acceptor_.value());
+            }
+        }
+        catch (boost::system::system_error const& e) {
+            as::post(
+                ioc_accept_,
+                [this, ec = e.code()] {
+                    if (h_error_) h_error_(ec);
+                }
+            );
+            return;
+        }
+        do_accept();
+    }
+
+    unsigned short port() const { return acceptor_.value().local_endpoint().port(); }
+
+    void close() {
+        close_request_ = true;
+        acceptor_.reset();
+    }
+
+    void set_accept_handler(accept_handler h = accept_handler()) {
+        h_accept_ = force_move(h);
+    }
+
+    /**
+     * @brief Set error handler
+     * @param h handler
+     */
+    void set_error_handler(error_handler h = error_handler()) {
+        h_error_ = force_move(h);
+    }
+
+    /**
+     * @brief Set MQTT protocol version
+     * @param version accepting protocol version
+     * If the specific version is set, only set version is accepted.
+     * If the version is set to protocol_version::undetermined, all versions are accepted.
+     * Initial value is protocol_version::undetermined.
+     */
+    void set_protocol_version(protocol_version version) {
+        version_ = version;
+    }
+
+    /**
+     * @brief Set configuration of the io_uring instance
+     * @param config configuration
+     * It is applied when the io_uring instance is created by the first listen() call.
+     */
+    void set_uring_config(uring_config const& config) {
+        uring_config_ = config;
+    }
+
+    /**
+     * @brief Get the io_uring instance
+     * @return io_uring instance. nullptr before listen() is called.
+     */
+    std::shared_ptr<uring_context> const& uring() const {
+        return uring_;
+    }
+
+    /**
+     * @brief Get reference of boost::asio::io_context for connections
+     * @return reference of boost::asio::io_context for connections
+     */
+    as::io_context& ioc_con() const {
+        return ioc_con_;
+    }
+
+    /**
+     * @brief Get reference of boost::asio::io_context for acceptor
+     * @return reference of boost::asio::io_context for acceptor
+     */
+    as::io_context& ioc_accept() const {
+        return ioc_accept_;
+    }
+
+private:
+    void do_accept() {
+        if (close_request_) return;
+        auto socket = std::make_shared<socket_t>(ioc_con_, uring_);
+        acceptor_.value().async_accept(
+            socket->lowest_layer(),
+            [this, socket]
+            (error_code ec) mutable {
+                if (ec) {
+                    acceptor_.reset();
+                    if (h_error_) h_error_(ec);
+                    return;
+                }
+                auto sp = std::make_shared<endpoint_t>(ioc_con_, force_move(socket), version_);
+                if (h_accept_) h_accept_(force_move(sp));
+                do_accept();
+            }
+        );
+    }
+
+private:
+    as::ip::tcp::endpoint ep_;
+    as::io_context& ioc_accept_;
+    as::io_context& ioc_con_;
+    optional<as::ip::tcp::acceptor> acceptor_;
+    std::function<void(as::ip::tcp::acceptor&)> config_;
+    bool close_request_{false};
+    accept_handler h_accept_;
+    error_handler h_error_;
+    protocol_version version_ = protocol_version::undetermined;
+    uring_config uring_config_;
+    std::shared_ptr<uring_context> uring_;
+};
+
+#endif // defined(MQTT_USE_IO_URING)
+
 #if defined(MQTT_USE_TLS)
 
 template <
     typename Strand = as::io_context::strand,
     typename Mutex = std::mutex,
     template<typename...> class LockGuard = std::lock_guard,
-    std::size_t PacketIdBytes = 2
+    std::size_t PacketIdBytes = 2,
+    typename Dispatch = type_erased_dispatch
 >
 class server_tls {
 public:
     using socket_t = tcp_endpoint<tls::stream<as::ip::tcp::socket>, Strand>;
-    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes>>;
+    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes, typename Dispatch::template socket_type<socket_t>>>;
 
     /**
      * @brief Accept handler
@@ -423,12 +618,13 @@ template <
     typename Strand = as::io_context::strand,
     typename Mutex = std::mutex,
     template<typename...> class LockGuard = std::lock_guard,
-    std::size_t PacketIdBytes = 2
+    std::size_t PacketIdBytes = 2,
+    typename Dispatch = type_erased_dispatch
 >
 class server_ws {
 public:
     using socket_t = ws_endpoint<as::ip::tcp::socket, Strand>;
-    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes>>;
+    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes, typename Dispatch::template socket_type<socket_t>>>;
 
     /**
      * @brief Accept handler
@@ -688,12 +884,13 @@ template <
     typename Strand = as::io_context::strand,
     typename Mutex = std::mutex,
     template<typename...> class LockGuard = std::lock_guard,
-    std::size_t PacketIdBytes = 2
+    std::size_t PacketIdBytes = 2,
+    typename Dispatch = type_erased_dispatch
 >
 class server_tls_ws {
 public:
     using socket_t = ws_endpoint<tls::stream<as::ip::tcp::socket>, Strand>;
-    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes>>;
+    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes, typename Dispatch::template socket_type<socket_t>>>;
 
     /**
      * @brief Accept handler
@@ -0,0 +1,107 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_STATIC_SOCKET_HPP)
+#define MQTT_STATIC_SOCKET_HPP
+
+#include <memory>
+#include <utility>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/type_erased_socket.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Socket holder that calls the concrete socket directly
+ *
+ * It provides the same interface as MQTT_NS::socket, but the calls are not type erased.
+ * Completion handlers are passed to the concrete socket as they are, so they are not
+ * converted to std::function and can be inlined.
+ * The endpoint that uses static_socket is instantiated for each socket type.
+ *
+ * @tparam Socket concrete socket type. e.g. tcp_endpoint, ws_endpoint
+ */
+template <typename Socket>
+class static_socket {
+public:
+    using socket_type = Socket;
+
+    static_socket(std::shared_ptr<Socket> socket)
+        :socket_(force_move(socket)) {}
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read(MutableBufferSequence&& buffers, ReadHandler&& handler) {
+        socket_->async_read(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write(ConstBufferSequence&& buffers, WriteHandler&& handler) {
+        socket_->async_write(std::forward<ConstBufferSequence>(buffers), std::forward<WriteHandler>(handler));
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write(ConstBufferSequence&& buffers, boost::system::error_code& ec) {
+        return socket_->write(std::forward<ConstBufferSequence>(buffers), ec);
+    }
+
+    template <typename PostHandler>
+    void post(PostHandler&& handler) {
+        socket_->post(std::forward<PostHandler>(handler));
+    }
+
+    decltype(auto) lowest_layer() {
+        return socket_->lowest_layer();
+    }
+
+    decltype(auto) native_handle() {
+        return socket_->native_handle();
+    }
+
+    void close(boost::system::error_code& ec) {
+        socket_->close(ec);
+    }
+
+    void force_shutdown_and_close(boost::system::error_code& ec) {
+        socket_->force_shutdown_and_close(ec);
+    }
+
+    decltype(auto) get_executor() {
+        return socket_->get_executor();
+    }
+
+    /**
+     * @brief Get the concrete socket
+     * @return concrete socket
+     */
+    Socket& get() const {
+        return *socket_;
+    }
+
+private:
+    std::shared_ptr<Socket> socket_;
+};
+
+/**
+ * @brief Endpoint holds the socket as MQTT_NS::socket. It is the default.
+ */
+struct type_erased_dispatch {
+    template <typename Socket>
+    using socket_type = MQTT_NS::socket;
+};
+
+/**
+ * @brief Endpoint holds the socket as static_socket of the concrete socket type.
+ */
+struct static_dispatch {
+    template <typename Socket>
+    using socket_type = static_socket<Socket>;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_STATIC_SOCKET_HPP
@@ -30,6 +30,10 @@ public:
         tcp_.lowest_layer().close(std::forward<Args>(args)...);
     }
 
+    void force_shutdown_and_close(boost::system::error_code& ec) {
+        tcp_.lowest_layer().close(ec);
+    }
+
     auto get_executor() {
         return lowest_layer().get_executor();
     }
@@ -30,6 +30,7 @@ BOOST_TYPE_ERASURE_MEMBER((MQTT_NS)(has_post), post, 1)
 BOOST_TYPE_ERASURE_MEMBER((MQTT_NS)(has_lowest_layer), lowest_layer, 0)
 BOOST_TYPE_ERASURE_MEMBER((MQTT_NS)(has_native_handle), native_handle, 0)
 BOOST_TYPE_ERASURE_MEMBER((MQTT_NS)(has_close), close, 1)
+BOOST_TYPE_ERASURE_MEMBER((MQTT_NS)(has_force_shutdown_and_close), force_shutdown_and_close, 1)
 BOOST_TYPE_ERASURE_MEMBER((MQTT_NS)(has_get_executor), get_executor, 0)
 
 namespace MQTT_NS {
@@ -44,6 +45,7 @@ using namespace boost::type_erasure;
  *   can be used as the initializer of MQTT_NS::socket.
  * - The class template endpoint uses MQTT_NS::socket via listed interface.
  * - lowest_layer is provided for users to configure the socket (e.g. set delay, buffer size, etc)
+ * - force_shutdown_and_close closes the socket without any closing handshake of the upper layer.
  *
  */
 using socket = shared_any<
@@ -56,6 +58,7 @@ using socket = shared_any<
         has_lowest_layer<as::ip::tcp::socket::lowest_layer_type&()>,
         has_native_handle<any()>,
         has_close<void(boost::system::error_code&)>,
+        has_force_shutdown_and_close<void(boost::system::error_code&)>,
 #if BOOST_VERSION < 107400 || defined(BOOST_ASIO_USE_TS_EXECUTOR_AS_DEFAULT)
         has_get_executor<as::executor()>
 #else  // BOOST_VERSION < 107400 || defined(BOOST_ASIO_USE_TS_EXECUTOR_AS_DEFAULT)
@@ -0,0 +1,948 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_URING_ENDPOINT_HPP)
+#define MQTT_URING_ENDPOINT_HPP
+
+#if defined(MQTT_USE_IO_URING)
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include <boost/assert.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+namespace as = boost::asio;
+
+/**
+ * @brief Configuration of uring_context
+ */
+struct uring_config {
+    /// number of submission queue entries
+    unsigned entries = 4096;
+    /// number of registered file slots. Clamped to RLIMIT_NOFILE.
+    unsigned files = 65536;
+    /// number of provided receive buffers. Rounded up to a power of two.
+    unsigned recv_buffers = 1024;
+    /// size of each provided receive buffer
+    std::size_t recv_buffer_size = 4096;
+    /// number of registered send buffers. 0 means sending from heap memory.
+    unsigned send_buffers = 1024;
+    /// size of each registered send buffer
+    std::size_t send_buffer_size = 4096;
+    /// send registered buffers with IORING_OP_SEND_ZC
+    bool send_zerocopy = false;
+    /// received bytes buffered per connection before the multishot receive is cancelled
+    std::size_t recv_buffered_limit = 65536;
+};
+
+/**
+ * @brief io_uring instance shared by uring_endpoints
+ *
+ * The ring is driven by the io_context. Completions are notified via an eventfd that is
+ * waited on by the io_context, and submissions made in one handler are submitted together
+ * by a single io_uring_enter() call posted to the io_context.
+ *
+ * Receiving uses multishot receive into a provided buffer ring that is shared by all
+ * connections, so idle connections don't hold receive buffers. Sockets are registered as
+ * fixed files and small sends are copied into registered buffers.
+ *
+ * The io_context must be run by a single thread. uring_context must be owned by std::shared_ptr.
+ */
+class uring_context : public std::enable_shared_from_this<uring_context> {
+public:
+    /**
+     * @brief In flight operation. Its address is used as the user_data of the sqe.
+     */
+    struct operation {
+        virtual ~operation() = default;
+
+        /**
+         * @brief Called on each cqe of the operation.
+         * @return true if no more cqe is posted for the operation. The operation is deleted.
+         */
+        virtual bool complete(std::int32_t res, std::uint32_t flags) = 0;
+    };
+
+    /**
+     * @brief Constructor
+     * @param ioc io_context that drives the ring
+     * @param config configuration
+     * Throws boost::system::system_error if io_uring is not available.
+     */
+    explicit uring_context(as::io_context& ioc, uring_config const& config = uring_config())
+        :ioc_(ioc),
+         efd_(ioc),
+         config_(config) {
+        try {
+            setup();
+        }
+        catch (...) {
+            cleanup();
+            throw;
+        }
+    }
+
+    uring_context(uring_context const&) = delete;
+    uring_context& operator=(uring_context const&) = delete;
+
+    ~uring_context() {
+        cleanup();
+    }
+
+    as::io_context& ioc() const {
+        return ioc_;
+    }
+
+    uring_config const& config() const {
+        return config_;
+    }
+
+    /**
+     * @brief Get an sqe. It is submitted after the current handler returns.
+     * @param op operation that receives the cqe. nullptr if the cqe should be ignored.
+     * @return cleared sqe
+     */
+    io_uring_sqe* get_sqe(operation* op) {
+        // wait for completions only while operations are in flight so that io_context::run()
+        // returns when there is no work, the same as asio sockets
+        if (op && inflight_++ == 0 && !waiting_) {
+            waiting_ = true;
+            async_wait_completion();
+        }
+        if (sq_tail_ - __atomic_load_n(sq_khead_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+            submit();
+            BOOST_ASSERT(sq_tail_ - __atomic_load_n(sq_khead_, __ATOMIC_ACQUIRE) < sq_entries_);
+        }
+        auto sqe = &sqes_[sq_tail_ & sq_mask_];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->user_data = reinterpret_cast<std::uint64_t>(op);
+        ++sq_tail_;
+        schedule_submit();
+        return sqe;
+    }
+
+    /**
+     * @brief Submit all pending sqes now.
+     */
+    void submit() {
+        auto to_submit = sq_tail_ - sq_submitted_;
+        if (to_submit == 0) return;
+        __atomic_store_n(sq_ktail_, sq_tail_, __ATOMIC_RELEASE);
+        sq_submitted_ = sq_tail_;
+        while (to_submit != 0) {
+            auto ret = enter(to_submit, 0);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                if ((errno == EBUSY || errno == EAGAIN) && reap() != 0) continue;
+                // remaining sqes are submitted by the next call
+                sq_submitted_ -= to_submit;
+                schedule_submit();
+                return;
+            }
+            to_submit -= static_cast<unsigned>(ret);
+        }
+    }
+
+    /**
+     * @brief Register a socket as a fixed file
+     * @param fd file descriptor
+     * @return slot. -1 if no slot is available.
+     */
+    int register_file(int fd) {
+        if (free_files_.empty()) return -1;
+        auto slot = free_files_.back();
+        if (update_file(slot, fd) != 1) return -1;
+        free_files_.pop_back();
+        return slot;
+    }
+
+    void unregister_file(int slot) {
+        update_file(slot, -1);
+        free_files_.push_back(slot);
+    }
+
+    /**
+     * @brief Get the group id of the provided receive buffers
+     */
+    std::uint16_t recv_buffer_group() const {
+        return recv_buffer_group_;
+    }
+
+    char const* recv_buffer(std::uint16_t bid) const {
+        return recv_mem_ + std::size_t(bid) * config_.recv_buffer_size;
+    }
+
+    /**
+     * @brief Give the provided buffer back to the kernel
+     */
+    void recycle_recv_buffer(std::uint16_t bid) {
+        auto& buf = buf_ring_[buf_ring_tail_ & buf_ring_mask_];
+        buf.addr = reinterpret_cast<std::uint64_t>(recv_buffer(bid));
+        buf.len = static_cast<std::uint32_t>(config_.recv_buffer_size);
+        buf.bid = bid;
+        ++buf_ring_tail_;
+        __atomic_store_n(buf_ring_ktail(), buf_ring_tail_, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @brief Acquire a registered send buffer
+     * @return index. -1 if no buffer is available.
+     */
+    int acquire_send_buffer() {
+        if (free_send_buffers_.empty()) return -1;
+        auto index = free_send_buffers_.back();
+        free_send_buffers_.pop_back();
+        return index;
+    }
+
+    void release_send_buffer(int index) {
+        free_send_buffers_.push_back(index);
+    }
+
+    char* send_buffer(int index) const {
+        return send_mem_ + std::size_t(index) * config_.send_buffer_size;
+    }
+
+    /**
+     * @brief Process all posted cqes
+     * @return number of processed cqes
+     */
+    std::size_t reap() {
+        std::size_t reaped = 0;
+        for (;;) {
+            auto head = *cq_khead_;
+            if (head == __atomic_load_n(cq_ktail_, __ATOMIC_ACQUIRE)) {
+                if (!(__atomic_load_n(sq_kflags_, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)) break;
+                // flush overflowed cqes to the ring
+                enter(0, IORING_ENTER_GETEVENTS);
+                if (head == __atomic_load_n(cq_ktail_, __ATOMIC_ACQUIRE)) break;
+            }
+            auto cqe = cqes_[head & cq_mask_];
+            // advance first, the operation might reap recursively
+            __atomic_store_n(cq_khead_, head + 1, __ATOMIC_RELEASE);
+            ++reaped;
+            if (cqe.user_data == 0) continue;
+            auto op = reinterpret_cast<operation*>(cqe.user_data);
+            if (op->complete(cqe.res, cqe.flags)) {
+                delete op;
+                --inflight_;
+            }
+        }
+        return reaped;
+    }
+
+private:
+    void setup() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CLAMP;
+        ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, config_.entries, &params));
+        if (ring_fd_ < 0) throw_errno("io_uring_setup");
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        }
+        else {
+            cq_ring_ = map(cq_ring_size_, IORING_OFF_CQ_RING);
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+
+        auto sq = static_cast<char*>(sq_ring_);
+        sq_khead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_ktail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_kflags_ = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_tail_ = sq_submitted_ = *sq_ktail_;
+        // sqes are always used in ring order
+        auto array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i != sq_entries_; ++i) array[i] = i;
+
+        auto cq = static_cast<char*>(cq_ring_);
+        cq_khead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_ktail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efd < 0) throw_errno("eventfd");
+        efd_.assign(efd);
+        if (do_register(IORING_REGISTER_EVENTFD, &efd, 1) < 0) throw_errno("IORING_REGISTER_EVENTFD");
+
+        setup_recv_buffers();
+        setup_files();
+        setup_send_buffers();
+    }
+
+    void setup_recv_buffers() {
+        unsigned entries = 1;
+        while (entries < config_.recv_buffers) entries <<= 1;
+        if (entries > 32768) entries = 32768;
+
+        buf_ring_size_ = entries * sizeof(io_uring_buf);
+        buf_ring_ = static_cast<io_uring_buf*>(map_anonymous(buf_ring_size_));
+        recv_mem_size_ = entries * config_.recv_buffer_size;
+        recv_mem_ = static_cast<char*>(map_anonymous(recv_mem_size_));
+
+        io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<std::uint64_t>(buf_ring_);
+        reg.ring_entries = entries;
+        reg.bgid = recv_buffer_group_;
+        if (do_register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) throw_errno("IORING_REGISTER_PBUF_RING");
+
+        buf_ring_mask_ = static_cast<std::uint16_t>(entries - 1);
+        for (unsigned i = 0; i != entries; ++i) {
+            recycle_recv_buffer(static_cast<std::uint16_t>(i));
+        }
+    }
+
+    void setup_files() {
+        rlimit rl;
+        auto files = config_.files;
+        if (::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < files) {
+            files = static_cast<unsigned>(rl.rlim_cur);
+        }
+        if (files == 0) return;
+        std::vector<int> fds(files, -1);
+        // fixed files are optional, raw file descriptors are used if not registered
+        if (do_register(IORING_REGISTER_FILES, fds.data(), files) < 0) return;
+        free_files_.reserve(files);
+        for (unsigned i = files; i != 0; --i) free_files_.push_back(static_cast<int>(i - 1));
+    }
+
+    void setup_send_buffers() {
+        if (config_.send_buffers == 0 || config_.send_buffer_size == 0) return;
+        send_mem_size_ = config_.send_buffers * config_.send_buffer_size;
+        send_mem_ = static_cast<char*>(map_anonymous(send_mem_size_));
+        std::vector<iovec> iovs(config_.send_buffers);
+        for (unsigned i = 0; i != config_.send_buffers; ++i) {
+            iovs[i].iov_base = send_buffer(static_cast<int>(i));
+            iovs[i].iov_len = config_.send_buffer_size;
+        }
+        // registered buffers are optional, heap memory is sent if not registered
+        if (do_register(IORING_REGISTER_BUFFERS, iovs.data(), config_.send_buffers) < 0) {
+            ::munmap(send_mem_, send_mem_size_);
+            send_mem_ = nullptr;
+            return;
+        }
+        free_send_buffers_.reserve(config_.send_buffers);
+        for (unsigned i = config_.send_buffers; i != 0; --i) free_send_buffers_.push_back(static_cast<int>(i - 1));
+    }
+
+    void cleanup() {
+        boost::system::error_code ec;
+        efd_.close(ec);
+        if (ring_fd_ >= 0) ::close(ring_fd_);
+        if (send_mem_) ::munmap(send_mem_, send_mem_size_);
+        if (recv_mem_) ::munmap(recv_mem_, recv_mem_size_);
+        if (buf_ring_) ::munmap(buf_ring_, buf_ring_size_);
+        if (sqes_) ::munmap(sqes_, sqes_size_);
+        if (cq_ring_ && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_) ::munmap(sq_ring_, sq_ring_size_);
+        ring_fd_ = -1;
+        send_mem_ = recv_mem_ = nullptr;
+        buf_ring_ = nullptr;
+        sqes_ = nullptr;
+        cq_ring_ = sq_ring_ = nullptr;
+    }
+
+    void schedule_submit() {
+        if (submit_scheduled_) return;
+        submit_scheduled_ = true;
+        as::post(
+            ioc_,
+            [wp = std::weak_ptr<uring_context>(this->shared_from_this())] {
+                if (auto sp = wp.lock()) {
+                    sp->submit_scheduled_ = false;
+                    sp->submit();
+                }
+            }
+        );
+    }
+
+    void async_wait_completion() {
+        efd_.async_wait(
+            as::posix::stream_descriptor::wait_read,
+            [wp = std::weak_ptr<uring_context>(this->shared_from_this())]
+            (error_code ec) {
+                if (ec) return;
+                auto sp = wp.lock();
+                if (!sp) return;
+                std::uint64_t count;
+                while (::read(sp->efd_.native_handle(), &count, sizeof(count)) < 0 && errno == EINTR);
+                sp->reap();
+                if (sp->inflight_ == 0) {
+                    sp->waiting_ = false;
+                }
+                else {
+                    sp->async_wait_completion();
+                }
+            }
+        );
+    }
+
+    int update_file(int slot, int fd) {
+        io_uring_files_update up;
+        std::memset(&up, 0, sizeof(up));
+        up.offset = static_cast<std::uint32_t>(slot);
+        up.fds = reinterpret_cast<std::uint64_t>(&fd);
+        return do_register(IORING_REGISTER_FILES_UPDATE, &up, 1);
+    }
+
+    int enter(unsigned to_submit, unsigned flags) {
+        return static_cast<int>(
+            ::syscall(__NR_io_uring_enter, ring_fd_, to_submit, 0, flags, nullptr, 0)
+        );
+    }
+
+    int do_register(unsigned opcode, void const* arg, unsigned nr_args) {
+        return static_cast<int>(
+            ::syscall(__NR_io_uring_register, ring_fd_, opcode, arg, nr_args)
+        );
+    }
+
+    void* map(std::size_t size, std::uint64_t offset) {
+        auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, static_cast<off_t>(offset));
+        if (p == MAP_FAILED) throw_errno("mmap");
+        return p;
+    }
+
+    static void* map_anonymous(std::size_t size) {
+        auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw_errno("mmap");
+        return p;
+    }
+
+    static void throw_errno(char const* what) {
+        throw boost::system::system_error(
+            boost::system::error_code(errno, boost::system::system_category()),
+            what
+        );
+    }
+
+    std::uint16_t* buf_ring_ktail() {
+        // the tail is overlaid with bufs[0].resv
+        return &buf_ring_[0].resv;
+    }
+
+    as::io_context& ioc_;
+    as::posix::stream_descriptor efd_;
+    uring_config config_;
+    int ring_fd_ = -1;
+
+    void* sq_ring_ = nullptr;
+    std::size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+
+    unsigned* sq_khead_ = nullptr;
+    unsigned* sq_ktail_ = nullptr;
+    unsigned* sq_kflags_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sq_tail_ = 0;
+    unsigned sq_submitted_ = 0;
+
+    unsigned* cq_khead_ = nullptr;
+    unsigned* cq_ktail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    io_uring_buf* buf_ring_ = nullptr;
+    std::size_t buf_ring_size_ = 0;
+    std::uint16_t buf_ring_mask_ = 0;
+    std::uint16_t buf_ring_tail_ = 0;
+    std::uint16_t recv_buffer_group_ = 0;
+    char* recv_mem_ = nullptr;
+    std::size_t recv_mem_size_ = 0;
+
+    char* send_mem_ = nullptr;
+    std::size_t send_mem_size_ = 0;
+    std::vector<int> free_send_buffers_;
+
+    std::vector<int> free_files_;
+
+    std::size_t inflight_ = 0;
+    bool submit_scheduled_ = false;
+    bool waiting_ = false;
+};
+
+/**
+ * @brief TCP socket driven by uring_context
+ *
+ * It satisfies MQTT_NS::socket. write() copies the buffers and returns immediately.
+ * The copied bytes are sent in order by the ring, and a send error is reported by the
+ * following write() calls and by the receiving side.
+ */
+template <typename Strand>
+class uring_endpoint {
+public:
+    using handler_t = std::function<void(error_code, std::size_t)>;
+
+    uring_endpoint(as::io_context& ioc, std::shared_ptr<uring_context> ctx)
+        :impl_(std::make_shared<impl>(ioc, force_move(ctx))) {
+    }
+
+    uring_endpoint(uring_endpoint const&) = delete;
+    uring_endpoint& operator=(uring_endpoint const&) = delete;
+
+    ~uring_endpoint() {
+        boost::system::error_code ec;
+        impl_->force_shutdown_and_close(ec);
+    }
+
+    void close(boost::system::error_code& ec) {
+        impl_->force_shutdown_and_close(ec);
+    }
+
+    void force_shutdown_and_close(boost::system::error_code& ec) {
+        impl_->force_shutdown_and_close(ec);
+    }
+
+    auto get_executor() {
+        return lowest_layer().get_executor();
+    }
+
+    as::ip::tcp::socket& socket() { return impl_->tcp_; }
+    as::ip::tcp::socket const& socket() const { return impl_->tcp_; }
+
+    as::ip::tcp::socket::lowest_layer_type& lowest_layer() {
+        return impl_->tcp_.lowest_layer();
+    }
+
+    as::ip::tcp::socket::native_handle_type native_handle() {
+        return impl_->tcp_.native_handle();
+    }
+
+    template <typename... Args>
+    void set_option(Args&& ... args) {
+        impl_->tcp_.set_option(std::forward<Args>(args)...);
+    }
+
+    template <typename ReadHandler>
+    void async_read(
+        as::mutable_buffer buffer,
+        ReadHandler&& handler) {
+        impl_->async_read(buffer, handler_t(std::forward<ReadHandler>(handler)));
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write(
+        ConstBufferSequence const& buffers,
+        boost::system::error_code& ec) {
+        return impl_->write(buffers, ec);
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write(
+        ConstBufferSequence const& buffers,
+        WriteHandler&& handler) {
+        impl_->async_write(buffers, handler_t(std::forward<WriteHandler>(handler)));
+    }
+
+    template <typename PostHandler>
+    void post(PostHandler&& handler) {
+        as::post(
+            impl_->strand_,
+            std::forward<PostHandler>(handler)
+        );
+    }
+
+private:
+    class impl : public std::enable_shared_from_this<impl> {
+    public:
+        impl(as::io_context& ioc, std::shared_ptr<uring_context> ctx)
+            :ctx_(force_move(ctx)),
+             tcp_(ioc),
+             strand_(ioc) {
+        }
+
+        ~impl() {
+            if (slot_ >= 0) ctx_->unregister_file(slot_);
+        }
+
+        void async_read(as::mutable_buffer buffer, handler_t h) {
+            BOOST_ASSERT(!read_handler_);
+            auto filled = consume(buffer);
+            if (filled == buffer.size()) {
+                invoke(force_move(h), error_code(), filled);
+                return;
+            }
+            if (closed_) {
+                invoke(force_move(h), as::error::operation_aborted, filled);
+                return;
+            }
+            if (recv_ec_) {
+                invoke(force_move(h), recv_ec_, filled);
+                return;
+            }
+            read_buffer_ = buffer;
+            read_filled_ = filled;
+            read_handler_ = force_move(h);
+            arm_recv();
+        }
+
+        template <typename ConstBufferSequence>
+        std::size_t write(ConstBufferSequence const& buffers, boost::system::error_code& ec) {
+            if (closed_) {
+                ec = as::error::bad_descriptor;
+                return 0;
+            }
+            if (send_ec_) {
+                ec = send_ec_;
+                return 0;
+            }
+            auto size = stage(buffers);
+            kick_send();
+            ec = boost::system::error_code();
+            return size;
+        }
+
+        template <typename ConstBufferSequence>
+        void async_write(ConstBufferSequence const& buffers, handler_t h) {
+            if (closed_) {
+                invoke(force_move(h), as::error::bad_descriptor, 0);
+                return;
+            }
+            if (send_ec_) {
+                invoke(force_move(h), send_ec_, 0);
+                return;
+            }
+            auto size = stage(buffers);
+            write_waiters_.push_back(write_waiter{ staged_total_, size, force_move(h) });
+            kick_send();
+        }
+
+        void force_shutdown_and_close(boost::system::error_code& ec) {
+            ec = boost::system::error_code();
+            if (closed_) return;
+            closed_ = true;
+            if (read_handler_) {
+                invoke(force_move(read_handler_), as::error::operation_aborted, read_filled_);
+                read_handler_ = nullptr;
+            }
+            if (!tcp_.is_open()) return;
+            // Send the staged bytes before the shutdown, the same as the kernel send buffer.
+            if (!sending_) {
+                kick_send();
+                ctx_->submit();
+            }
+            fail_write_waiters(as::error::operation_aborted);
+            staged_.clear();
+            // wake up the in flight operations. They hold the file.
+            ::shutdown(tcp_.native_handle(), SHUT_RDWR);
+            if (slot_ >= 0) {
+                ctx_->unregister_file(slot_);
+                slot_ = -1;
+            }
+            tcp_.close(ec);
+        }
+
+    private:
+        friend class uring_endpoint;
+
+        struct write_waiter {
+            std::uint64_t end;
+            std::size_t size;
+            handler_t h;
+        };
+
+        struct recv_op : uring_context::operation {
+            explicit recv_op(std::shared_ptr<impl> owner)
+                :owner(force_move(owner)) {}
+            bool complete(std::int32_t res, std::uint32_t flags) override {
+                return owner->recv_completed(res, flags);
+            }
+            std::shared_ptr<impl> owner;
+        };
+
+        struct send_op : uring_context::operation {
+            send_op(std::shared_ptr<impl> owner, std::shared_ptr<void> buffer)
+                :owner(force_move(owner)), buffer(force_move(buffer)) {}
+            bool complete(std::int32_t res, std::uint32_t flags) override {
+                if (flags & IORING_CQE_F_NOTIF) return true;
+                owner->send_completed(res);
+                // zerocopy send posts a notification when the buffer can be reused
+                return !(flags & IORING_CQE_F_MORE);
+            }
+            std::shared_ptr<impl> owner;
+            // keeps the registered send buffer
+            std::shared_ptr<void> buffer;
+        };
+
+        void invoke(handler_t h, error_code ec, std::size_t size) {
+            as::post(
+                strand_,
+                [h = force_move(h), ec, size] {
+                    h(ec, size);
+                }
+            );
+        }
+
+        std::size_t buffered() const {
+            return received_.size() - received_pos_;
+        }
+
+        std::size_t consume(as::mutable_buffer buffer) {
+            auto size = std::min(buffer.size(), buffered());
+            std::memcpy(buffer.data(), received_.data() + received_pos_, size);
+            received_pos_ += size;
+            if (received_pos_ == received_.size()) {
+                received_.clear();
+                received_pos_ = 0;
+            }
+            return size;
+        }
+
+        void deliver(char const* data, std::size_t size) {
+            if (read_handler_) {
+                auto copied = std::min(size, read_buffer_.size() - read_filled_);
+                std::memcpy(static_cast<char*>(read_buffer_.data()) + read_filled_, data, copied);
+                read_filled_ += copied;
+                data += copied;
+                size -= copied;
+                if (read_filled_ == read_buffer_.size()) {
+                    auto h = force_move(read_handler_);
+                    read_handler_ = nullptr;
+                    invoke(force_move(h), error_code(), read_filled_);
+                }
+            }
+            received_.insert(received_.end(), data, data + size);
+        }
+
+        void ensure_registered() {
+            if (registration_tried_) return;
+            registration_tried_ = true;
+            slot_ = ctx_->register_file(tcp_.native_handle());
+        }
+
+        void set_file(io_uring_sqe* sqe) {
+            if (slot_ >= 0) {
+                sqe->fd = slot_;
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
+            else {
+                sqe->fd = tcp_.native_handle();
+            }
+        }
+
+        void arm_recv() {
+            if (recv_op_ || recv_ec_ || closed_) return;
+            ensure_registered();
+            recv_op_ = new recv_op(this->shared_from_this());
+            auto sqe = ctx_->get_sqe(recv_op_);
+            sqe->opcode = IORING_OP_RECV;
+            set_file(sqe);
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->buf_group = ctx_->recv_buffer_group();
+            recv_cancel_requested_ = false;
+        }
+
+        bool recv_completed(std::int32_t res, std::uint32_t flags) {
+            bool more = flags & IORING_CQE_F_MORE;
+            if (res > 0) {
+                BOOST_ASSERT(flags & IORING_CQE_F_BUFFER);
+                auto bid = static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+                deliver(ctx_->recv_buffer(bid), static_cast<std::size_t>(res));
+                ctx_->recycle_recv_buffer(bid);
+            }
+            else if (res == 0) {
+                recv_ec_ = as::error::eof;
+            }
+            else if (res == -ENOBUFS || (res == -ECANCELED && !closed_)) {
+                // re-armed below if required
+            }
+            else {
+                recv_ec_ = error_code(-res, boost::system::system_category());
+            }
+            if (!more) recv_op_ = nullptr;
+
+            if (recv_ec_ && read_handler_) {
+                auto h = force_move(read_handler_);
+                read_handler_ = nullptr;
+                invoke(force_move(h), recv_ec_, read_filled_);
+            }
+            else if (!recv_op_) {
+                if (read_handler_) arm_recv();
+            }
+            else if (!read_handler_ &&
+                     !recv_cancel_requested_ &&
+                     buffered() >= ctx_->config().recv_buffered_limit) {
+                // nobody reads, stop receiving until the next async_read()
+                recv_cancel_requested_ = true;
+                auto sqe = ctx_->get_sqe(nullptr);
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = reinterpret_cast<std::uint64_t>(static_cast<uring_context::operation*>(recv_op_));
+            }
+            return !more;
+        }
+
+        template <typename ConstBufferSequence>
+        std::size_t stage(ConstBufferSequence const& buffers) {
+            std::size_t size = 0;
+            for (auto const& b : buffers) {
+                auto p = static_cast<char const*>(b.data());
+                staged_.insert(staged_.end(), p, p + b.size());
+                size += b.size();
+            }
+            staged_total_ += size;
+            return size;
+        }
+
+        void kick_send() {
+            if (sending_ || staged_.empty()) return;
+            ensure_registered();
+            int index = staged_.size() <= ctx_->config().send_buffer_size ? ctx_->acquire_send_buffer() : -1;
+            if (index >= 0) {
+                std::memcpy(ctx_->send_buffer(index), staged_.data(), staged_.size());
+                send_data_ = ctx_->send_buffer(index);
+                send_size_ = staged_.size();
+                staged_.clear();
+                send_buffer_ = std::shared_ptr<void>(
+                    nullptr,
+                    [ctx = ctx_, index](void*) {
+                        ctx->release_send_buffer(index);
+                    }
+                );
+            }
+            else {
+                sending_heap_.clear();
+                sending_heap_.swap(staged_);
+                send_data_ = sending_heap_.data();
+                send_size_ = sending_heap_.size();
+            }
+            send_offset_ = 0;
+            send_buffer_index_ = index;
+            sending_ = true;
+            submit_send();
+        }
+
+        void submit_send() {
+            bool zerocopy = send_buffer_index_ >= 0 && ctx_->config().send_zerocopy;
+            // the registered buffer is released when the last send_op of it is deleted
+            auto sqe = ctx_->get_sqe(new send_op(this->shared_from_this(), send_buffer_));
+            sqe->opcode = zerocopy ? IORING_OP_SEND_ZC : IORING_OP_SEND;
+            set_file(sqe);
+            sqe->addr = reinterpret_cast<std::uint64_t>(send_data_ + send_offset_);
+            sqe->len = static_cast<std::uint32_t>(send_size_ - send_offset_);
+            sqe->msg_flags = MSG_NOSIGNAL;
+            if (zerocopy) {
+                sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+                sqe->buf_index = static_cast<std::uint16_t>(send_buffer_index_);
+            }
+        }
+
+        void send_completed(std::int32_t res) {
+            if (res < 0) {
+                send_ec_ = error_code(-res, boost::system::system_category());
+                finish_send();
+                fail_write_waiters(send_ec_);
+                staged_.clear();
+                return;
+            }
+            send_offset_ += static_cast<std::size_t>(res);
+            sent_total_ += static_cast<std::uint64_t>(res);
+            while (!write_waiters_.empty() && write_waiters_.front().end <= sent_total_) {
+                auto w = force_move(write_waiters_.front());
+                write_waiters_.pop_front();
+                invoke(force_move(w.h), error_code(), w.size);
+            }
+            if (send_offset_ < send_size_ && !closed_) {
+                submit_send();
+                return;
+            }
+            finish_send();
+            kick_send();
+        }
+
+        void finish_send() {
+            send_buffer_.reset();
+            send_buffer_index_ = -1;
+            sending_ = false;
+        }
+
+        void fail_write_waiters(error_code ec) {
+            while (!write_waiters_.empty()) {
+                auto w = force_move(write_waiters_.front());
+                write_waiters_.pop_front();
+                invoke(force_move(w.h), ec, 0);
+            }
+        }
+
+        std::shared_ptr<uring_context> ctx_;
+        as::ip::tcp::socket tcp_;
+        Strand strand_;
+        int slot_ = -1;
+        bool registration_tried_ = false;
+        bool closed_ = false;
+
+        // receiving
+        std::vector<char> received_;
+        std::size_t received_pos_ = 0;
+        as::mutable_buffer read_buffer_;
+        std::size_t read_filled_ = 0;
+        handler_t read_handler_;
+        recv_op* recv_op_ = nullptr;
+        bool recv_cancel_requested_ = false;
+        error_code recv_ec_;
+
+        // sending
+        std::vector<char> staged_;
+        std::uint64_t staged_total_ = 0;
+        std::uint64_t sent_total_ = 0;
+        std::deque<write_waiter> write_waiters_;
+        bool sending_ = false;
+        std::vector<char> sending_heap_;
+        char const* send_data_ = nullptr;
+        std::size_t send_size_ = 0;
+        std::size_t send_offset_ = 0;
+        int send_buffer_index_ = -1;
+        std::shared_ptr<void> send_buffer_;
+        error_code send_ec_;
+    };
+
+    std::shared_ptr<impl> impl_;
+};
+
+} // namespace MQTT_NS
+
+#endif // defined(MQTT_USE_IO_URING)
+
+#endif // MQTT_URING_ENDPOINT_HPP
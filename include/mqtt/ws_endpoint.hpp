@@ -9,11 +9,13 @@
 
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/core/buffers_suffix.hpp>
 #include <boost/asio/bind_executor.hpp>
 
 #include <mqtt/namespace.hpp>
 #include <mqtt/string_view.hpp>
 #include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
 
 namespace MQTT_NS {
 
@@ -47,6 +49,10 @@ public:
         ec = boost::system::errc::make_error_code(boost::system::errc::success);
     }
 
+    void force_shutdown_and_close(boost::system::error_code& ec) {
+        lowest_layer().close(ec);
+    }
+
     auto get_executor() {
         return lowest_layer().get_executor();
     }
@@ -103,67 +109,30 @@ public:
         ws_.handshake(std::forward<Args>(args)...);
     }
 
+    /**
+     * @brief Read the websocket message payload directly into the buffers.
+     *
+     * The payload is read by the websocket stream's async_read_some into the caller's buffers,
+     * so no intermediate buffer and no per-read allocation is required.
+     * Small reads (e.g. mqtt fixed header) are served from the websocket stream's read buffer.
+     * An mqtt control packet can span websocket messages.
+     */
     template <typename MutableBufferSequence, typename ReadHandler>
     void async_read(
         MutableBufferSequence const& buffers,
         ReadHandler&& handler) {
         auto req_size = as::buffer_size(buffers);
-
-        using beast_read_handler_t =
-            std::function<void(error_code ec, std::shared_ptr<void>)>;
-
-        std::shared_ptr<beast_read_handler_t> beast_read_handler;
-        if (req_size <= buffer_.size()) {
-            as::buffer_copy(buffers, buffer_.data(), req_size);
-            buffer_.consume(req_size);
-            handler(boost::system::errc::make_error_code(boost::system::errc::success), req_size);
+        if (req_size == 0) {
+            handler(boost::system::errc::make_error_code(boost::system::errc::success), 0);
             return;
         }
-
-        beast_read_handler.reset(
-            new beast_read_handler_t(
-                [this, req_size, buffers, handler = std::forward<ReadHandler>(handler)]
-                (error_code ec, std::shared_ptr<void> const& v) mutable {
-                    if (ec) {
-                        std::forward<ReadHandler>(handler)(ec, 0);
-                        return;
-                    }
-                    if (!ws_.got_binary()) {
-                        buffer_.consume(buffer_.size());
-                        std::forward<ReadHandler>(handler)
-                            (boost::system::errc::make_error_code(boost::system::errc::bad_message), 0);
-                        return;
-                    }
-                    if (req_size > buffer_.size()) {
-                        auto beast_read_handler = std::static_pointer_cast<beast_read_handler_t>(v);
-                        ws_.async_read(
-                            buffer_,
-                            as::bind_executor(
-                                strand_,
-                                [beast_read_handler]
-                                (error_code ec, std::size_t) {
-                                    (*beast_read_handler)(ec, beast_read_handler);
-                                }
-                            )
-                        );
-                        return;
-                    }
-                    as::buffer_copy(buffers, buffer_.data(), req_size);
-                    buffer_.consume(req_size);
-                    std::forward<ReadHandler>(handler)(boost::system::errc::make_error_code(boost::system::errc::success), req_size);
-                }
-            )
-        );
-        ws_.async_read(
-            buffer_,
-            as::bind_executor(
-                strand_,
-                [beast_read_handler]
-                (error_code ec, std::size_t) {
-                    (*beast_read_handler)(ec, beast_read_handler);
-                }
-            )
-        );
+        read_op<MutableBufferSequence, std::decay_t<ReadHandler>>{
+            *this,
+            boost::beast::buffers_suffix<MutableBufferSequence>(buffers),
+            req_size,
+            0,
+            std::forward<ReadHandler>(handler)
+        }.start();
     }
 
     template <typename ConstBufferSequence>
@@ -203,8 +172,46 @@ public:
     }
 
 private:
+    template <typename MutableBufferSequence, typename ReadHandler>
+    struct read_op {
+        void start() {
+            // Copy the remaining buffers before *this is moved into the completion handler.
+            auto rest = rest_;
+            ep_.ws_.async_read_some(
+                rest,
+                as::bind_executor(
+                    ep_.strand_,
+                    force_move(*this)
+                )
+            );
+        }
+
+        void operator()(error_code ec, std::size_t bytes_transferred) {
+            if (ec) {
+                handler_(ec, 0);
+                return;
+            }
+            if (!ep_.ws_.got_binary()) {
+                handler_(boost::system::errc::make_error_code(boost::system::errc::bad_message), 0);
+                return;
+            }
+            transferred_ += bytes_transferred;
+            if (transferred_ < req_size_) {
+                rest_.consume(bytes_transferred);
+                start();
+                return;
+            }
+            handler_(boost::system::errc::make_error_code(boost::system::errc::success), req_size_);
+        }
+
+        ws_endpoint& ep_;
+        boost::beast::buffers_suffix<MutableBufferSequence> rest_;
+        std::size_t req_size_;
+        std::size_t transferred_;
+        ReadHandler handler_;
+    };
+
     boost::beast::websocket::stream<Socket> ws_;
-    boost::beast::flat_buffer buffer_;
     Strand strand_;
 };
 
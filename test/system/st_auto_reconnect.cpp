@@ -0,0 +1,192 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+BOOST_AUTO_TEST_SUITE(st_auto_reconnect)
+
+namespace {
+
+void reconnect(MQTT_NS::protocol_version version) {
+
+    //
+    // c1 subscribes topic1, then the connection is broken.
+    // c1 publishes to topic1 while it is offline.
+    // After reconnecting, the subscription is restored and the queued publish is sent,
+    // so c1 receives its own message.
+    //
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port, version);
+    c->set_clean_session(true);
+    c->set_client_id("cid1");
+    c->set_auto_reconnect(true);
+    c->set_reconnect_delay(std::chrono::milliseconds(10), std::chrono::milliseconds(100));
+    c->set_offline_publish_limit(1);
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+
+    checker chk = {
+        cont("h_connack1"),
+        cont("h_suback"),
+        cont("h_error"),
+        cont("h_offline_full"),
+        cont("h_connack2"),
+        cont("h_publish"),
+        cont("h_close"),
+    };
+
+    std::size_t connack_count = 0;
+    auto on_connack =
+        [&] {
+            if (++connack_count == 1) {
+                MQTT_CHK("h_connack1");
+                c->async_subscribe("topic1", MQTT_NS::qos::at_least_once);
+            }
+            else {
+                MQTT_CHK("h_connack2");
+            }
+        };
+    auto on_suback =
+        [&] {
+            // Only the first suback is checked. The second one is for the restored subscription.
+            if (connack_count != 1) return;
+            MQTT_CHK("h_suback");
+            boost::system::error_code ec;
+            c->socket()->lowest_layer().shutdown(as::ip::tcp::socket::shutdown_both, ec);
+        };
+
+    if (version == MQTT_NS::protocol_version::v5) {
+        c->set_v5_connack_handler(
+            [&]
+            (bool, MQTT_NS::v5::connect_reason_code reason_code, MQTT_NS::v5::properties) {
+                BOOST_TEST(reason_code == MQTT_NS::v5::connect_reason_code::success);
+                on_connack();
+                return true;
+            }
+        );
+        c->set_v5_suback_handler(
+            [&]
+            (packet_id_t, std::vector<MQTT_NS::v5::suback_reason_code>, MQTT_NS::v5::properties) {
+                on_suback();
+                return true;
+            }
+        );
+    }
+    else {
+        c->set_connack_handler(
+            [&]
+            (bool, MQTT_NS::connect_return_code connack_return_code) {
+                BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                on_connack();
+                return true;
+            }
+        );
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<MQTT_NS::suback_return_code>) {
+                on_suback();
+                return true;
+            }
+        );
+    }
+    c->set_publish_handler(
+        [&]
+        (MQTT_NS::optional<packet_id_t>,
+         MQTT_NS::publish_options,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents) {
+            MQTT_CHK("h_publish");
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "offline1");
+            c->async_disconnect();
+            return true;
+        }
+    );
+    c->set_v5_publish_handler(
+        [&]
+        (MQTT_NS::optional<packet_id_t>,
+         MQTT_NS::publish_options,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents,
+         MQTT_NS::v5::properties) {
+            MQTT_CHK("h_publish");
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "offline1");
+            c->async_disconnect();
+            return true;
+        }
+    );
+    c->set_error_handler(
+        [&]
+        (MQTT_NS::error_code) {
+            MQTT_CHK("h_error");
+            c->async_publish("topic1", "offline1", MQTT_NS::qos::at_least_once);
+            c->async_publish(
+                "topic1",
+                "offline2",
+                MQTT_NS::qos::at_least_once,
+                [&](MQTT_NS::error_code ec) {
+                    // The offline queue is full.
+                    BOOST_TEST(ec == boost::system::errc::no_buffer_space);
+                    MQTT_CHK("h_offline_full");
+                }
+            );
+        }
+    );
+    c->set_close_handler(
+        [&]
+        () {
+            MQTT_CHK("h_close");
+            finish();
+        }
+    );
+
+    c->async_connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( reconnect_v3_1_1 ) {
+    reconnect(MQTT_NS::protocol_version::v3_1_1);
+}
+
+BOOST_AUTO_TEST_CASE( reconnect_v5 ) {
+    reconnect(MQTT_NS::protocol_version::v5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,146 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+
+#include <mqtt/awaitable.hpp>
+
+BOOST_AUTO_TEST_SUITE(st_coroutine)
+
+namespace {
+
+void pubsub(MQTT_NS::protocol_version version) {
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port, version);
+    c->set_clean_session(true);
+    c->set_client_id("cid1");
+
+    MQTT_NS::awaitable_endpoint<typename decltype(c)::element_type> ac(c);
+
+    checker chk = {
+        cont("h_connack"),
+        cont("suback"),
+        cont("published"),
+        cont("received"),
+        cont("unsuback"),
+        cont("eof"),
+    };
+
+    auto proc =
+        [&] () -> as::awaitable<void> {
+            if (version == MQTT_NS::protocol_version::v5) {
+                std::vector<std::tuple<std::string, MQTT_NS::subscribe_options>> entries {
+                    { "topic1", MQTT_NS::qos::exactly_once }
+                };
+                auto reasons = co_await ac.v5_subscribe(MQTT_NS::force_move(entries));
+                BOOST_TEST(reasons.size() == 1U);
+                BOOST_TEST(reasons[0] == MQTT_NS::v5::suback_reason_code::granted_qos_2);
+            }
+            else {
+                auto results = co_await ac.subscribe("topic1", MQTT_NS::qos::exactly_once);
+                BOOST_TEST(results.size() == 1U);
+                BOOST_TEST(results[0] == MQTT_NS::suback_return_code::success_maximum_qos_2);
+            }
+            MQTT_CHK("suback");
+
+            co_await ac.publish("topic1", "contents0", MQTT_NS::qos::at_most_once);
+            co_await ac.publish("topic1", "contents1", MQTT_NS::qos::at_least_once);
+            co_await ac.publish("topic1", "contents2", MQTT_NS::qos::exactly_once);
+            MQTT_CHK("published");
+
+            for (int i = 0; i != 3; ++i) {
+                auto msg = co_await ac.receive();
+                BOOST_TEST(msg.topic == "topic1");
+                BOOST_TEST(msg.contents == "contents" + std::to_string(i));
+                BOOST_TEST(msg.pubopts.get_qos() == static_cast<MQTT_NS::qos>(i));
+            }
+            MQTT_CHK("received");
+
+            std::vector<std::string> topics { "topic1" };
+            co_await ac.unsubscribe(MQTT_NS::force_move(topics));
+            MQTT_CHK("unsuback");
+
+            c->async_disconnect();
+            try {
+                co_await ac.receive();
+                BOOST_CHECK(false);
+            }
+            catch (boost::system::system_error const& e) {
+                BOOST_TEST(e.code() == as::error::eof);
+                MQTT_CHK("eof");
+            }
+            finish();
+        };
+
+    if (version == MQTT_NS::protocol_version::v5) {
+        c->set_v5_connack_handler(
+            [&]
+            (bool, MQTT_NS::v5::connect_reason_code, MQTT_NS::v5::properties) {
+                MQTT_CHK("h_connack");
+                as::co_spawn(ioc, proc, as::detached);
+                return true;
+            }
+        );
+    }
+    else {
+        c->set_connack_handler(
+            [&]
+            (bool, MQTT_NS::connect_return_code) {
+                MQTT_CHK("h_connack");
+                as::co_spawn(ioc, proc, as::detached);
+                return true;
+            }
+        );
+    }
+
+    c->async_connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( pubsub_v3_1_1 ) {
+    pubsub(MQTT_NS::protocol_version::v3_1_1);
+}
+
+BOOST_AUTO_TEST_CASE( pubsub_v5 ) {
+    pubsub(MQTT_NS::protocol_version::v5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,332 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+BOOST_AUTO_TEST_SUITE(st_counters)
+
+using namespace MQTT_NS::literals;
+
+BOOST_AUTO_TEST_CASE( endpoint_and_broker ) {
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_client_id("cid1");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+
+    checker chk = {
+        cont("h_connack"),
+        cont("h_suback"),
+        // publish topic1 QoS1 retain
+        deps("h_puback", "h_suback"),
+        deps("h_publish", "h_suback"),
+        cont("h_close"),
+    };
+
+    auto check_and_disconnect =
+        [&] {
+            if (chk.passed("h_puback") && chk.passed("h_publish")) {
+                c->disconnect();
+            }
+        };
+
+    c->set_connack_handler(
+        [&chk, &c, &b]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            BOOST_TEST(b.get_counters().sessions_online() == 1U);
+            c->subscribe("topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        }
+    );
+    c->set_suback_handler(
+        [&chk, &c, &b]
+        (packet_id_t, std::vector<MQTT_NS::suback_return_code> results) {
+            MQTT_CHK("h_suback");
+            BOOST_TEST(results.size() == 1U);
+            BOOST_TEST(b.get_counters().subscriptions() == 1U);
+            c->publish("topic1", "contents", MQTT_NS::qos::at_least_once | MQTT_NS::retain::yes);
+            return true;
+        }
+    );
+    c->set_puback_handler(
+        [&chk, &check_and_disconnect]
+        (packet_id_t) {
+            MQTT_CHK("h_puback");
+            check_and_disconnect();
+            return true;
+        }
+    );
+    c->set_publish_handler(
+        [&chk, &check_and_disconnect]
+        (MQTT_NS::optional<packet_id_t>,
+         MQTT_NS::publish_options,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents) {
+            MQTT_CHK("h_publish");
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "contents");
+            check_and_disconnect();
+            return true;
+        }
+    );
+    c->set_close_handler(
+        [&chk, &finish]
+        () {
+            MQTT_CHK("h_close");
+            finish();
+        }
+    );
+    c->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+
+    auto cs = c->get_counters().get_snapshot();
+    BOOST_TEST(cs.sent(MQTT_NS::control_packet_type::connect) == 1U);
+    BOOST_TEST(cs.sent(MQTT_NS::control_packet_type::subscribe) == 1U);
+    BOOST_TEST(cs.sent(MQTT_NS::control_packet_type::publish) == 1U);
+    BOOST_TEST(cs.sent(MQTT_NS::control_packet_type::puback) == 1U);
+    BOOST_TEST(cs.sent(MQTT_NS::control_packet_type::disconnect) == 1U);
+    BOOST_TEST(cs.total_packets_sent() == 5U);
+    BOOST_TEST(cs.received(MQTT_NS::control_packet_type::connack) == 1U);
+    BOOST_TEST(cs.received(MQTT_NS::control_packet_type::suback) == 1U);
+    BOOST_TEST(cs.received(MQTT_NS::control_packet_type::publish) == 1U);
+    BOOST_TEST(cs.received(MQTT_NS::control_packet_type::puback) == 1U);
+    BOOST_TEST(cs.total_packets_received() == 4U);
+    BOOST_TEST(cs.bytes_sent == c->get_total_bytes_sent());
+    BOOST_TEST(cs.bytes_received == c->get_total_bytes_received());
+    BOOST_TEST(cs.bytes_received > 0U);
+    BOOST_TEST(cs.queue_depth == 0U);
+    BOOST_TEST(cs.queue_bytes == 0U);
+    BOOST_TEST(cs.store_size == 0U);
+
+    auto bs = b.get_counters().get_snapshot();
+    BOOST_TEST(bs.sessions_online == 0U);
+    BOOST_TEST(bs.sessions_offline == 0U);
+    BOOST_TEST(bs.subscriptions == 0U);
+    BOOST_TEST(bs.retained_messages == 1U);
+    BOOST_TEST(bs.retained_bytes == "topic1"_mb.size() + "contents"_mb.size());
+    BOOST_TEST(bs.endpoints.received(MQTT_NS::control_packet_type::connect) == 1U);
+    BOOST_TEST(bs.endpoints.received(MQTT_NS::control_packet_type::publish) == 1U);
+    BOOST_TEST(bs.endpoints.sent(MQTT_NS::control_packet_type::publish) == 1U);
+    BOOST_TEST(bs.endpoints.bytes_received == cs.bytes_sent);
+    BOOST_TEST(bs.endpoints.queue_depth == 0U);
+#if defined(MQTT_USE_LATENCY_HISTOGRAM)
+    BOOST_TEST(cs.receive_latency.count == cs.total_packets_received());
+    BOOST_TEST(cs.process_latency.count == cs.total_packets_received());
+    BOOST_TEST(cs.send_latency.count == cs.total_packets_sent());
+    BOOST_TEST(bs.endpoints.send_latency.count == bs.endpoints.total_packets_sent());
+#endif // defined(MQTT_USE_LATENCY_HISTOGRAM)
+
+    b.clear_all_retained_topics();
+    BOOST_TEST(b.get_counters().retained_messages() == 0U);
+    BOOST_TEST(b.get_counters().retained_bytes() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( offline_session ) {
+
+    //
+    // c1 ---- broker ----- c2 (CleanSession: false)
+    //
+    // 1. c2 subscribe t1 QoS1
+    // 2. c2 disconnect
+    // 3. c1 publish t1 QoS1
+    // 4. c2 connect again with CleanSession: true (discard the offline message)
+    //
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_clean_session(true);
+    c1->set_client_id("cid1");
+
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c2->set_clean_session(false);
+    c2->set_client_id("cid2");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c1)>::packet_id_t;
+
+    checker chk = {
+        cont("c1_h_connack"),
+        cont("c2_h_connack1"),
+        cont("c2_h_suback"),
+        cont("c2_h_close1"),
+        cont("c1_h_puback"),
+        cont("c2_h_connack2"),
+        cont("c1_h_close"),
+        cont("c2_h_close2"),
+    };
+
+    c1->set_connack_handler(
+        [&chk, &c2]
+        (bool, MQTT_NS::connect_return_code) {
+            MQTT_CHK("c1_h_connack");
+            c2->connect();
+            return true;
+        }
+    );
+    c2->set_connack_handler(
+        [&chk, &c1, &c2, &b]
+        (bool, MQTT_NS::connect_return_code) {
+            auto ret = chk.match(
+                "c1_h_connack",
+                [&] {
+                    MQTT_CHK("c2_h_connack1");
+                    c2->subscribe("topic1", MQTT_NS::qos::at_least_once);
+                },
+                "c1_h_puback",
+                [&] {
+                    MQTT_CHK("c2_h_connack2");
+                    auto bs = b.get_counters().get_snapshot();
+                    BOOST_TEST(bs.sessions_online == 2U);
+                    BOOST_TEST(bs.sessions_offline == 0U);
+                    BOOST_TEST(bs.offline_messages == 0U);
+                    BOOST_TEST(bs.messages_discarded == 1U);
+                    c1->disconnect();
+                }
+            );
+            BOOST_TEST(ret);
+            return true;
+        }
+    );
+    c2->set_suback_handler(
+        [&chk, &c2]
+        (packet_id_t, std::vector<MQTT_NS::suback_return_code>) {
+            MQTT_CHK("c2_h_suback");
+            c2->disconnect();
+            return true;
+        }
+    );
+    c2->set_close_handler(
+        [&chk, &c1, &finish]
+        () {
+            auto ret = chk.match(
+                "c2_h_suback",
+                [&] {
+                    MQTT_CHK("c2_h_close1");
+                    c1->publish("topic1", "topic1_contents", MQTT_NS::qos::at_least_once);
+                },
+                "c1_h_close",
+                [&] {
+                    MQTT_CHK("c2_h_close2");
+                    finish();
+                }
+            );
+            BOOST_TEST(ret);
+        }
+    );
+    c1->set_puback_handler(
+        [&chk, &c2, &b]
+        (packet_id_t) {
+            MQTT_CHK("c1_h_puback");
+            auto bs = b.get_counters().get_snapshot();
+            BOOST_TEST(bs.sessions_online == 1U);
+            BOOST_TEST(bs.sessions_offline == 1U);
+            BOOST_TEST(bs.subscriptions == 1U);
+            BOOST_TEST(bs.offline_messages == 1U);
+            c2->set_clean_session(true);
+            c2->connect();
+            return true;
+        }
+    );
+    c1->set_close_handler(
+        [&chk, &c2]
+        () {
+            MQTT_CHK("c1_h_close");
+            c2->disconnect();
+        }
+    );
+
+    c1->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+    c2->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c1->connect();
+
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+
+    auto bs = b.get_counters().get_snapshot();
+    BOOST_TEST(bs.sessions_online == 0U);
+    BOOST_TEST(bs.sessions_offline == 0U);
+    BOOST_TEST(bs.subscriptions == 0U);
+    BOOST_TEST(bs.offline_messages == 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,197 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+#include <cstdio>
+
+#include <mqtt/mmap_store.hpp>
+
+BOOST_AUTO_TEST_SUITE(st_mmap_store)
+
+namespace {
+
+void restore_and_resend(MQTT_NS::protocol_version version) {
+
+    //
+    // c1 publishes messages while it is offline, and they are stored to the file.
+    // The store is re-opened by c2 (as if the process is restarted), and c2 sends
+    // the restored messages to the broker.
+    //
+
+    std::string path = "st_mmap_store.ring";
+    std::remove(path.c_str());
+
+    {
+        boost::asio::io_context ioc;
+        // The initial capacity is small, so the file is enlarged.
+        MQTT_NS::mmap_store<> st(path, 64);
+        auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, version);
+        st.attach(*c1);
+        c1->set_client_id("cid1");
+        c1->set_clean_session(false);
+        c1->publish("topic1", "topic1_contents1", MQTT_NS::qos::at_least_once);
+        c1->publish("topic1", "topic1_contents2", MQTT_NS::qos::exactly_once);
+        c1->publish("topic1", "topic1_contents3", MQTT_NS::qos::at_least_once);
+        BOOST_TEST(st.size() == 3U);
+        BOOST_TEST(st.capacity() > 64U);
+    }
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    {
+        boost::asio::io_context ioc;
+        MQTT_NS::mmap_store<> st(path);
+        st.set_sync_interval(1);
+        BOOST_TEST(st.size() == 3U);
+
+        auto c2 = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port, version);
+        st.attach(*c2);
+        c2->set_client_id("cid1");
+        c2->set_clean_session(false);
+
+        using packet_id_t = typename std::remove_reference_t<decltype(*c2)>::packet_id_t;
+
+        checker chk = {
+            cont("h_connack"),
+            deps("h_puback1", "h_connack"),
+            deps("h_puback2", "h_puback1"),
+            deps("h_pubcomp", "h_connack"),
+            deps("h_close", "h_puback2", "h_pubcomp"),
+        };
+
+        std::size_t acked = 0;
+        auto on_acked =
+            [&] {
+                if (++acked == 3) c2->async_disconnect();
+            };
+        auto on_puback =
+            [&] {
+                auto ret = chk.match(
+                    "h_connack",
+                    [&] {
+                        MQTT_CHK("h_puback1");
+                    },
+                    "h_puback1",
+                    [&] {
+                        MQTT_CHK("h_puback2");
+                    }
+                );
+                BOOST_TEST(ret);
+                on_acked();
+            };
+
+        c2->set_connack_handler(
+            [&]
+            (bool, MQTT_NS::connect_return_code connack_return_code) {
+                BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                MQTT_CHK("h_connack");
+                return true;
+            }
+        );
+        c2->set_v5_connack_handler(
+            [&]
+            (bool, MQTT_NS::v5::connect_reason_code reason_code, MQTT_NS::v5::properties) {
+                BOOST_TEST(reason_code == MQTT_NS::v5::connect_reason_code::success);
+                MQTT_CHK("h_connack");
+                return true;
+            }
+        );
+        c2->set_puback_handler(
+            [&]
+            (packet_id_t) {
+                on_puback();
+                return true;
+            }
+        );
+        c2->set_v5_puback_handler(
+            [&]
+            (packet_id_t, MQTT_NS::v5::puback_reason_code, MQTT_NS::v5::properties) {
+                on_puback();
+                return true;
+            }
+        );
+        c2->set_pubcomp_handler(
+            [&]
+            (packet_id_t) {
+                MQTT_CHK("h_pubcomp");
+                on_acked();
+                return true;
+            }
+        );
+        c2->set_v5_pubcomp_handler(
+            [&]
+            (packet_id_t, MQTT_NS::v5::pubcomp_reason_code, MQTT_NS::v5::properties) {
+                MQTT_CHK("h_pubcomp");
+                on_acked();
+                return true;
+            }
+        );
+        c2->set_close_handler(
+            [&]
+            () {
+                MQTT_CHK("h_close");
+                finish();
+            }
+        );
+        c2->set_error_handler(
+            []
+            (MQTT_NS::error_code) {
+                BOOST_CHECK(false);
+            }
+        );
+
+        c2->async_connect();
+        ioc.run();
+        BOOST_TEST(chk.all());
+        BOOST_TEST(st.size() == 0U);
+    }
+    th.join();
+
+    {
+        // All messages are removed from the file.
+        MQTT_NS::mmap_store<> st(path);
+        BOOST_TEST(st.size() == 0U);
+    }
+    std::remove(path.c_str());
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( restore_and_resend_v3_1_1 ) {
+    restore_and_resend(MQTT_NS::protocol_version::v3_1_1);
+}
+
+BOOST_AUTO_TEST_CASE( restore_and_resend_v5 ) {
+    restore_and_resend(MQTT_NS::protocol_version::v5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
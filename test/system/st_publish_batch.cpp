@@ -0,0 +1,252 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+BOOST_AUTO_TEST_SUITE(st_publish_batch)
+
+namespace {
+
+void pubsub(MQTT_NS::protocol_version version) {
+
+    //
+    // c1 subscribes topic1 and publishes three messages (QoS0, QoS1, QoS2) by one batch.
+    //
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port, version);
+    c->set_clean_session(true);
+    c->set_client_id("cid1");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+
+    checker chk = {
+        cont("h_connack"),
+        cont("h_suback"),
+        cont("h_batch_written"),
+        deps("h_publish1", "h_batch_written"),
+        deps("h_puback", "h_batch_written"),
+        deps("h_publish2", "h_publish1"),
+        deps("h_pubcomp", "h_puback"),
+        deps("h_publish3", "h_publish2"),
+        deps("h_close", "h_publish3", "h_pubcomp"),
+    };
+
+    std::vector<packet_id_t> pids;
+    std::size_t received = 0;
+    bool completed = false;
+    auto disconnect =
+        [&] {
+            if (received == 3 && completed) c->async_disconnect();
+        };
+
+    auto on_suback =
+        [&] {
+            MQTT_CHK("h_suback");
+            std::vector<MQTT_NS::publish_batch_entry> entries {
+                { "topic1", "contents1", MQTT_NS::qos::at_most_once },
+                { "topic1", "contents2", MQTT_NS::qos::at_least_once },
+                { "topic1", "contents3", MQTT_NS::qos::exactly_once },
+            };
+            pids = c->async_publish_batch(
+                MQTT_NS::force_move(entries),
+                [&]
+                (MQTT_NS::error_code ec) {
+                    MQTT_CHK("h_batch_written");
+                    BOOST_TEST(!ec);
+                    // the batch is written by one write, so no message waited for another
+                    auto sn = c->get_counters().get_snapshot();
+                    BOOST_TEST(sn.write_stalls == 0U);
+                }
+            );
+            BOOST_TEST(pids.size() == 3U);
+            BOOST_TEST(pids[0] == 0U);
+            BOOST_TEST(pids[1] != 0U);
+            BOOST_TEST(pids[2] != 0U);
+            BOOST_TEST(pids[1] != pids[2]);
+        };
+    auto on_publish =
+        [&]
+        (MQTT_NS::buffer topic, MQTT_NS::buffer contents) {
+            BOOST_TEST(topic == "topic1");
+            switch (++received) {
+            case 1:
+                MQTT_CHK("h_publish1");
+                BOOST_TEST(contents == "contents1");
+                break;
+            case 2:
+                MQTT_CHK("h_publish2");
+                BOOST_TEST(contents == "contents2");
+                break;
+            case 3:
+                MQTT_CHK("h_publish3");
+                BOOST_TEST(contents == "contents3");
+                disconnect();
+                break;
+            default:
+                BOOST_CHECK(false);
+                break;
+            }
+        };
+    auto on_puback =
+        [&]
+        (packet_id_t packet_id) {
+            MQTT_CHK("h_puback");
+            BOOST_TEST(packet_id == pids[1]);
+        };
+    auto on_pubcomp =
+        [&]
+        (packet_id_t packet_id) {
+            MQTT_CHK("h_pubcomp");
+            BOOST_TEST(packet_id == pids[2]);
+            completed = true;
+            disconnect();
+        };
+
+    if (version == MQTT_NS::protocol_version::v5) {
+        c->set_v5_connack_handler(
+            [&]
+            (bool, MQTT_NS::v5::connect_reason_code, MQTT_NS::v5::properties) {
+                MQTT_CHK("h_connack");
+                c->async_subscribe("topic1", MQTT_NS::qos::exactly_once);
+                return true;
+            }
+        );
+        c->set_v5_suback_handler(
+            [&]
+            (packet_id_t, std::vector<MQTT_NS::v5::suback_reason_code>, MQTT_NS::v5::properties) {
+                on_suback();
+                return true;
+            }
+        );
+        c->set_v5_publish_handler(
+            [&]
+            (MQTT_NS::optional<packet_id_t>,
+             MQTT_NS::publish_options,
+             MQTT_NS::buffer topic,
+             MQTT_NS::buffer contents,
+             MQTT_NS::v5::properties) {
+                on_publish(MQTT_NS::force_move(topic), MQTT_NS::force_move(contents));
+                return true;
+            }
+        );
+        c->set_v5_puback_handler(
+            [&]
+            (packet_id_t packet_id, MQTT_NS::v5::puback_reason_code, MQTT_NS::v5::properties) {
+                on_puback(packet_id);
+                return true;
+            }
+        );
+        c->set_v5_pubcomp_handler(
+            [&]
+            (packet_id_t packet_id, MQTT_NS::v5::pubcomp_reason_code, MQTT_NS::v5::properties) {
+                on_pubcomp(packet_id);
+                return true;
+            }
+        );
+    }
+    else {
+        c->set_connack_handler(
+            [&]
+            (bool, MQTT_NS::connect_return_code) {
+                MQTT_CHK("h_connack");
+                c->async_subscribe("topic1", MQTT_NS::qos::exactly_once);
+                return true;
+            }
+        );
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<MQTT_NS::suback_return_code>) {
+                on_suback();
+                return true;
+            }
+        );
+        c->set_publish_handler(
+            [&]
+            (MQTT_NS::optional<packet_id_t>,
+             MQTT_NS::publish_options,
+             MQTT_NS::buffer topic,
+             MQTT_NS::buffer contents) {
+                on_publish(MQTT_NS::force_move(topic), MQTT_NS::force_move(contents));
+                return true;
+            }
+        );
+        c->set_puback_handler(
+            [&]
+            (packet_id_t packet_id) {
+                on_puback(packet_id);
+                return true;
+            }
+        );
+        c->set_pubcomp_handler(
+            [&]
+            (packet_id_t packet_id) {
+                on_pubcomp(packet_id);
+                return true;
+            }
+        );
+    }
+    c->set_close_handler(
+        [&]
+        () {
+            MQTT_CHK("h_close");
+            auto sn = c->get_counters().get_snapshot();
+            BOOST_TEST(sn.sent(MQTT_NS::control_packet_type::publish) == 3U);
+            finish();
+        }
+    );
+    c->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c->async_connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( pubsub_v3_1_1 ) {
+    pubsub(MQTT_NS::protocol_version::v3_1_1);
+}
+
+BOOST_AUTO_TEST_CASE( pubsub_v5 ) {
+    pubsub(MQTT_NS::protocol_version::v5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,207 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+BOOST_AUTO_TEST_SUITE(st_publisher_backpressure)
+
+BOOST_AUTO_TEST_CASE( pause_and_resume ) {
+
+    //
+    // c1 ---- broker ----- c2 (Receive Maximum: 1)
+    //
+    // 1. c2 subscribe t1 QoS1
+    // 2. c1 publish t1 QoS1 x 3
+    // 3. message 1 is sent to c2, message 2 is queued and the broker stops reading from c1
+    // 4. c2 send PUBACK for message 1
+    // 5. message 2 is sent and the broker resumes reading from c1
+    //
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    b.set_publisher_backpressure(1, 0);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c1->set_clean_start(true);
+    c1->set_client_id("cid1");
+
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c2->set_clean_start(true);
+    c2->set_client_id("cid2");
+    c2->set_auto_pub_response(false);
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c1)>::packet_id_t;
+
+    checker chk = {
+        cont("c2_h_connack"),
+        cont("c2_h_suback"),
+        cont("c1_h_connack"),
+        deps("c2_h_publish1", "c1_h_connack"),
+        deps("c1_h_puback2", "c1_h_connack"),
+        // c1 is paused. c2 sends PUBACK after a while.
+        deps("c2_puback1", "c2_h_publish1", "c1_h_puback2"),
+        deps("c2_h_publish2", "c2_puback1"),
+        deps("c1_h_puback3", "c2_puback1"),
+        deps("c2_h_publish3", "c2_h_publish2"),
+        deps("c1_h_close", "c2_h_publish3", "c1_h_puback3"),
+        cont("c2_h_close"),
+    };
+
+    std::size_t c1_pubacks = 0;
+    MQTT_NS::optional<packet_id_t> first_pid;
+    as::steady_timer tim(ioc);
+
+    auto ack_first_later =
+        [&] {
+            if (!first_pid || c1_pubacks != 2) return;
+            // If the broker read message 3, PUBACK would arrive to c1 in the meantime.
+            tim.expires_after(std::chrono::milliseconds(100));
+            tim.async_wait(
+                [&]
+                (MQTT_NS::error_code ec) {
+                    BOOST_TEST(!ec);
+                    BOOST_TEST(c1_pubacks == 2U);
+                    MQTT_CHK("c2_puback1");
+                    c2->puback(first_pid.value());
+                }
+            );
+        };
+
+    c2->set_v5_connack_handler(
+        [&chk, &c2]
+        (bool, MQTT_NS::v5::connect_reason_code, MQTT_NS::v5::properties /*props*/) {
+            MQTT_CHK("c2_h_connack");
+            c2->subscribe("topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        }
+    );
+    c2->set_v5_suback_handler(
+        [&chk, &c1]
+        (packet_id_t, std::vector<MQTT_NS::v5::suback_reason_code>, MQTT_NS::v5::properties /*props*/) {
+            MQTT_CHK("c2_h_suback");
+            c1->connect();
+            return true;
+        }
+    );
+    c1->set_v5_connack_handler(
+        [&chk, &c1]
+        (bool, MQTT_NS::v5::connect_reason_code, MQTT_NS::v5::properties /*props*/) {
+            MQTT_CHK("c1_h_connack");
+            c1->publish("topic1", "1", MQTT_NS::qos::at_least_once);
+            c1->publish("topic1", "2", MQTT_NS::qos::at_least_once);
+            c1->publish("topic1", "3", MQTT_NS::qos::at_least_once);
+            return true;
+        }
+    );
+    c1->set_v5_puback_handler(
+        [&]
+        (packet_id_t, MQTT_NS::v5::puback_reason_code, MQTT_NS::v5::properties /*props*/) {
+            switch (++c1_pubacks) {
+            case 1:
+                break;
+            case 2:
+                MQTT_CHK("c1_h_puback2");
+                ack_first_later();
+                break;
+            case 3:
+                MQTT_CHK("c1_h_puback3");
+                break;
+            default:
+                BOOST_CHECK(false);
+                break;
+            }
+            return true;
+        }
+    );
+    c2->set_v5_publish_handler(
+        [&]
+        (MQTT_NS::optional<packet_id_t> packet_id,
+         MQTT_NS::publish_options,
+         MQTT_NS::buffer /*topic*/,
+         MQTT_NS::buffer contents,
+         MQTT_NS::v5::properties /*props*/) {
+            if (contents == "1") {
+                MQTT_CHK("c2_h_publish1");
+                first_pid = packet_id;
+                ack_first_later();
+            }
+            else if (contents == "2") {
+                MQTT_CHK("c2_h_publish2");
+                c2->puback(packet_id.value());
+            }
+            else {
+                MQTT_CHK("c2_h_publish3");
+                BOOST_TEST(contents == "3");
+                c2->puback(packet_id.value());
+                c1->disconnect();
+            }
+            return true;
+        }
+    );
+    c1->set_close_handler(
+        [&chk, &c2]
+        () {
+            MQTT_CHK("c1_h_close");
+            c2->disconnect();
+        }
+    );
+    c2->set_close_handler(
+        [&chk, &finish]
+        () {
+            MQTT_CHK("c2_h_close");
+            finish();
+        }
+    );
+    c1->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+    c2->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c2->connect(
+        MQTT_NS::v5::properties{
+            MQTT_NS::v5::property::receive_maximum(1)
+        }
+    );
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,391 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+BOOST_AUTO_TEST_SUITE(st_receive_maximum)
+
+BOOST_AUTO_TEST_CASE( online ) {
+
+    //
+    // c1 ---- broker ----- c2 (Receive Maximum: 1)
+    //
+    // 1. c2 subscribe t1 QoS1
+    // 2. c1 publish t1 QoS1 x 3
+    // 3. broker sends only the first message to c2 until c2 sends PUBACK
+    //
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c1->set_clean_start(true);
+    c1->set_client_id("cid1");
+
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c2->set_clean_start(true);
+    c2->set_client_id("cid2");
+    c2->set_auto_pub_response(false);
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c1)>::packet_id_t;
+
+    checker chk = {
+        cont("c2_h_connack"),
+        cont("c2_h_suback"),
+        cont("c1_h_connack"),
+        cont("c1_h_close"),
+        cont("c2_h_close"),
+    };
+
+    std::size_t c1_pubacks = 0;
+    std::size_t c2_received = 0;
+    std::size_t c2_acked = 0;
+    MQTT_NS::optional<packet_id_t> first_pid;
+
+    auto ack_first =
+        [&] {
+            if (first_pid && c1_pubacks == 3) {
+                ++c2_acked;
+                c2->puback(first_pid.value());
+                first_pid = MQTT_NS::nullopt;
+            }
+        };
+
+    c2->set_v5_connack_handler(
+        [&chk, &c2]
+        (bool sp, MQTT_NS::v5::connect_reason_code connack_reason_code, MQTT_NS::v5::properties /*props*/) {
+            MQTT_CHK("c2_h_connack");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_reason_code == MQTT_NS::v5::connect_reason_code::success);
+            c2->subscribe("topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        }
+    );
+    c2->set_v5_suback_handler(
+        [&chk, &c1]
+        (packet_id_t, std::vector<MQTT_NS::v5::suback_reason_code>, MQTT_NS::v5::properties /*props*/) {
+            MQTT_CHK("c2_h_suback");
+            c1->connect();
+            return true;
+        }
+    );
+    c1->set_v5_connack_handler(
+        [&chk, &c1]
+        (bool, MQTT_NS::v5::connect_reason_code, MQTT_NS::v5::properties /*props*/) {
+            MQTT_CHK("c1_h_connack");
+            c1->publish("topic1", "1", MQTT_NS::qos::at_least_once);
+            c1->publish("topic1", "2", MQTT_NS::qos::at_least_once);
+            c1->publish("topic1", "3", MQTT_NS::qos::at_least_once);
+            return true;
+        }
+    );
+    c1->set_v5_puback_handler(
+        [&]
+        (packet_id_t, MQTT_NS::v5::puback_reason_code, MQTT_NS::v5::properties /*props*/) {
+            if (++c1_pubacks == 3) {
+                // broker has processed all publishes.
+                // 1 is sent to c2 and 2 and 3 are waiting for the inflight window.
+                BOOST_TEST(b.get_counters().offline_messages() == 2U);
+                ack_first();
+            }
+            return true;
+        }
+    );
+    c2->set_v5_publish_handler(
+        [&]
+        (MQTT_NS::optional<packet_id_t> packet_id,
+         MQTT_NS::publish_options pubopts,
+         MQTT_NS::buffer /*topic*/,
+         MQTT_NS::buffer contents,
+         MQTT_NS::v5::properties /*props*/) {
+            BOOST_TEST(pubopts.get_qos() == MQTT_NS::qos::at_least_once);
+            BOOST_TEST(packet_id.has_value());
+            ++c2_received;
+            // only one message is inflight
+            BOOST_TEST(c2_received == c2_acked + 1);
+            BOOST_TEST(contents == std::to_string(c2_received));
+            if (c2_received == 1) {
+                first_pid = packet_id;
+                ack_first();
+            }
+            else {
+                ++c2_acked;
+                c2->puback(packet_id.value());
+                if (c2_received == 3) c1->disconnect();
+            }
+            return true;
+        }
+    );
+    c1->set_close_handler(
+        [&chk, &c2]
+        () {
+            MQTT_CHK("c1_h_close");
+            c2->disconnect();
+        }
+    );
+    c2->set_close_handler(
+        [&chk, &finish]
+        () {
+            MQTT_CHK("c2_h_close");
+            finish();
+        }
+    );
+    c1->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+    c2->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c2->connect(
+        MQTT_NS::v5::properties{
+            MQTT_NS::v5::property::receive_maximum(1)
+        }
+    );
+    ioc.run();
+    BOOST_TEST(chk.all());
+    BOOST_TEST(c2_received == 3U);
+    th.join();
+    BOOST_TEST(b.get_counters().offline_messages() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( resume ) {
+
+    //
+    // c1 ---- broker ----- c2 (CleanStart: false)
+    //
+    // 1. c2 subscribe t1 QoS1
+    // 2. c2 disconnect
+    // 3. c1 publish t1 QoS1 x 3
+    // 4. c2 connect again with Receive Maximum: 1
+    // 5. broker sends the stored messages one by one
+    //
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c1->set_clean_start(true);
+    c1->set_client_id("cid1");
+
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c2->set_clean_start(false);
+    c2->set_client_id("cid2");
+    c2->set_auto_pub_response(false);
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c1)>::packet_id_t;
+
+    checker chk = {
+        cont("c1_h_connack"),
+        cont("c2_h_connack1"),
+        cont("c2_h_suback"),
+        cont("c2_h_close1"),
+        cont("c2_h_connack2"),
+        cont("c1_h_close"),
+        cont("c2_h_close2"),
+    };
+
+    std::size_t c1_pubacks = 0;
+    std::size_t c2_received = 0;
+    std::size_t c2_acked = 0;
+    MQTT_NS::optional<packet_id_t> pending_pid;
+
+    c1->set_v5_connack_handler(
+        [&chk, &c2]
+        (bool, MQTT_NS::v5::connect_reason_code, MQTT_NS::v5::properties /*props*/) {
+            MQTT_CHK("c1_h_connack");
+            c2->connect(
+                MQTT_NS::v5::properties{
+                    MQTT_NS::v5::property::session_expiry_interval(
+                        MQTT_NS::session_never_expire
+                    )
+                }
+            );
+            return true;
+        }
+    );
+    c2->set_v5_connack_handler(
+        [&chk, &c2]
+        (bool sp, MQTT_NS::v5::connect_reason_code, MQTT_NS::v5::properties /*props*/) {
+            auto ret = chk.match(
+                "c1_h_connack",
+                [&] {
+                    MQTT_CHK("c2_h_connack1");
+                    BOOST_TEST(sp == false);
+                    c2->subscribe("topic1", MQTT_NS::qos::at_least_once);
+                },
+                "c2_h_close1",
+                [&] {
+                    MQTT_CHK("c2_h_connack2");
+                    BOOST_TEST(sp == true);
+                }
+            );
+            BOOST_TEST(ret);
+            return true;
+        }
+    );
+    c2->set_v5_suback_handler(
+        [&chk, &c2]
+        (packet_id_t, std::vector<MQTT_NS::v5::suback_reason_code>, MQTT_NS::v5::properties /*props*/) {
+            MQTT_CHK("c2_h_suback");
+            c2->disconnect();
+            return true;
+        }
+    );
+    c1->set_v5_puback_handler(
+        [&]
+        (packet_id_t, MQTT_NS::v5::puback_reason_code, MQTT_NS::v5::properties /*props*/) {
+            if (++c1_pubacks == 3) {
+                BOOST_TEST(b.get_counters().offline_messages() == 3U);
+                c2->connect(
+                    MQTT_NS::v5::properties{
+                        MQTT_NS::v5::property::session_expiry_interval(
+                            MQTT_NS::session_never_expire
+                        ),
+                        MQTT_NS::v5::property::receive_maximum(1)
+                    }
+                );
+            }
+            return true;
+        }
+    );
+    c2->set_v5_publish_handler(
+        [&]
+        (MQTT_NS::optional<packet_id_t> packet_id,
+         MQTT_NS::publish_options,
+         MQTT_NS::buffer /*topic*/,
+         MQTT_NS::buffer contents,
+         MQTT_NS::v5::properties /*props*/) {
+            ++c2_received;
+            // only one message is inflight
+            BOOST_TEST(c2_received == c2_acked + 1);
+            BOOST_TEST(contents == std::to_string(c2_received));
+            if (c2_received == 3) {
+                ++c2_acked;
+                c2->puback(packet_id.value());
+                c1->disconnect();
+            }
+            else {
+                // If the broker sent the next message without the window,
+                // it would arrive before PINGRESP.
+                pending_pid = packet_id;
+                c2->pingreq();
+            }
+            return true;
+        }
+    );
+    c2->set_pingresp_handler(
+        [&] {
+            if (pending_pid) {
+                ++c2_acked;
+                c2->puback(pending_pid.value());
+                pending_pid = MQTT_NS::nullopt;
+            }
+            return true;
+        }
+    );
+    c2->set_close_handler(
+        [&chk, &c1, &finish]
+        () {
+            auto ret = chk.match(
+                "c2_h_suback",
+                [&] {
+                    MQTT_CHK("c2_h_close1");
+                    c1->publish("topic1", "1", MQTT_NS::qos::at_least_once);
+                    c1->publish("topic1", "2", MQTT_NS::qos::at_least_once);
+                    c1->publish("topic1", "3", MQTT_NS::qos::at_least_once);
+                },
+                "c1_h_close",
+                [&] {
+                    MQTT_CHK("c2_h_close2");
+                    finish();
+                }
+            );
+            BOOST_TEST(ret);
+        }
+    );
+    c1->set_close_handler(
+        [&chk, &c2]
+        () {
+            MQTT_CHK("c1_h_close");
+            c2->disconnect();
+        }
+    );
+    c1->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+    c2->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c1->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    BOOST_TEST(c2_received == 3U);
+    th.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,177 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+BOOST_AUTO_TEST_SUITE(st_static_dispatch)
+
+BOOST_AUTO_TEST_CASE( echo ) {
+
+    //
+    // The server uses static_dispatch and sends back received publish messages.
+    //
+
+    using server_t = MQTT_NS::server<
+        as::io_context::strand,
+        std::mutex,
+        std::lock_guard,
+        2,
+        MQTT_NS::static_dispatch
+    >;
+    using static_con_t = server_t::endpoint_t;
+    using static_con_sp_t = std::shared_ptr<static_con_t>;
+
+    static_assert(
+        std::is_same<
+            static_con_t::socket_t,
+            MQTT_NS::static_socket<MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>>
+        >::value,
+        "endpoint should hold the concrete socket"
+    );
+
+    boost::asio::io_context ioc;
+
+    server_t s(
+        as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port),
+        ioc,
+        [](auto& acceptor) {
+            acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+        }
+    );
+
+    checker chk = {
+        cont("s_h_connect"),
+        cont("c_h_connack"),
+        cont("s_h_publish1"),
+        cont("c_h_publish1"),
+        cont("s_h_publish2"),
+        cont("c_h_publish2"),
+        cont("s_h_disconnect"),
+        cont("c_h_close"),
+    };
+
+    s.set_accept_handler(
+        [&](static_con_sp_t spep) {
+            auto& ep = *spep;
+            std::weak_ptr<static_con_t> wp(spep);
+            using packet_id_t = typename std::remove_reference_t<decltype(ep)>::packet_id_t;
+            ep.start_session(MQTT_NS::force_move(spep));
+            ep.set_connect_handler(
+                [&chk, wp]
+                (MQTT_NS::buffer,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::will>,
+                 bool,
+                 std::uint16_t) {
+                    MQTT_CHK("s_h_connect");
+                    auto sp = wp.lock();
+                    BOOST_ASSERT(sp);
+                    sp->connack(false, MQTT_NS::connect_return_code::accepted);
+                    return true;
+                }
+            );
+            ep.set_publish_handler(
+                [&chk, wp]
+                (MQTT_NS::optional<packet_id_t>,
+                 MQTT_NS::publish_options pubopts,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents) {
+                    auto ret = chk.match(
+                        "c_h_connack",
+                        [&] {
+                            MQTT_CHK("s_h_publish1");
+                        },
+                        "c_h_publish1",
+                        [&] {
+                            MQTT_CHK("s_h_publish2");
+                        }
+                    );
+                    BOOST_TEST(ret);
+                    auto sp = wp.lock();
+                    BOOST_ASSERT(sp);
+                    sp->async_publish(
+                        MQTT_NS::force_move(topic),
+                        MQTT_NS::force_move(contents),
+                        pubopts.get_qos()
+                    );
+                    return true;
+                }
+            );
+            ep.set_disconnect_handler(
+                [&chk, &s]
+                () {
+                    MQTT_CHK("s_h_disconnect");
+                    s.close();
+                }
+            );
+        }
+    );
+    s.listen();
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_client_id("cid1");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+
+    c->set_connack_handler(
+        [&chk, &c]
+        (bool, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("c_h_connack");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c->publish("topic1", "contents1", MQTT_NS::qos::at_most_once);
+            return true;
+        }
+    );
+    c->set_publish_handler(
+        [&chk, &c]
+        (MQTT_NS::optional<packet_id_t>,
+         MQTT_NS::publish_options,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents) {
+            BOOST_TEST(topic == "topic1");
+            auto ret = chk.match(
+                "s_h_publish1",
+                [&] {
+                    MQTT_CHK("c_h_publish1");
+                    BOOST_TEST(contents == "contents1");
+                    c->publish("topic1", "contents2", MQTT_NS::qos::at_most_once);
+                },
+                "s_h_publish2",
+                [&] {
+                    MQTT_CHK("c_h_publish2");
+                    BOOST_TEST(contents == "contents2");
+                    c->disconnect();
+                }
+            );
+            BOOST_TEST(ret);
+            return true;
+        }
+    );
+    c->set_close_handler(
+        [&chk]
+        () {
+            MQTT_CHK("c_h_close");
+        }
+    );
+    c->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
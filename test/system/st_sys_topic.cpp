@@ -0,0 +1,136 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+BOOST_AUTO_TEST_SUITE(st_sys_topic)
+
+BOOST_AUTO_TEST_CASE( publish ) {
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_no_tls> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            b.set_sys_interval(std::chrono::milliseconds(10));
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    b.set_sys_interval(std::chrono::steady_clock::duration::zero());
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_client_id("cid1");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+
+    checker chk = {
+        cont("h_connack"),
+        // subscribe #
+        cont("h_suback1"),
+        // subscribe $SYS/broker/clients/connected
+        cont("h_suback2"),
+        cont("h_close"),
+    };
+
+    bool topic1_received = false;
+    bool connected_received = false;
+
+    c->set_connack_handler(
+        [&chk, &c]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c->subscribe("#", MQTT_NS::qos::at_most_once);
+            return true;
+        }
+    );
+    c->set_suback_handler(
+        [&chk, &c]
+        (packet_id_t, std::vector<MQTT_NS::suback_return_code>) {
+            auto ret = chk.match(
+                "h_connack",
+                [&] {
+                    MQTT_CHK("h_suback1");
+                    c->subscribe("$SYS/broker/clients/connected", MQTT_NS::qos::at_most_once);
+                },
+                "h_suback1",
+                [&] {
+                    MQTT_CHK("h_suback2");
+                    c->publish("topic1", "contents", MQTT_NS::qos::at_most_once);
+                }
+            );
+            BOOST_TEST(ret);
+            return true;
+        }
+    );
+    c->set_publish_handler(
+        [&c, &topic1_received, &connected_received]
+        (MQTT_NS::optional<packet_id_t>,
+         MQTT_NS::publish_options,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents) {
+            auto received = topic1_received && connected_received;
+            if (topic == "topic1") {
+                // delivered via #
+                BOOST_TEST(!topic1_received);
+                topic1_received = true;
+            }
+            else {
+                // $SYS topics are not delivered via #
+                BOOST_TEST(topic == "$SYS/broker/clients/connected");
+                if (contents == "1") connected_received = true;
+            }
+            if (!received && topic1_received && connected_received) {
+                c->disconnect();
+            }
+            return true;
+        }
+    );
+    c->set_close_handler(
+        [&chk, &finish]
+        () {
+            MQTT_CHK("h_close");
+            finish();
+        }
+    );
+    c->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+
+    BOOST_TEST(b.get_counters().retained_messages() > 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,295 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+#include "test_util.hpp"
+#include "../common/global_fixture.hpp"
+
+BOOST_AUTO_TEST_SUITE(st_uring)
+
+namespace {
+
+class test_server_uring {
+public:
+    test_server_uring(as::io_context& ioc, MQTT_NS::broker::broker_t& b)
+        : server_(
+            as::ip::tcp::endpoint(
+                as::ip::tcp::v4(), broker_notls_port
+            ),
+            ioc,
+            [](auto& acceptor) {
+                acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+            }
+        ), b_(b) {
+        server_.set_error_handler(
+            [](MQTT_NS::error_code /*ec*/) {
+            }
+        );
+
+        server_.set_accept_handler(
+            [&](con_sp_t spep) {
+                b_.handle_accept(MQTT_NS::force_move(spep));
+            }
+        );
+
+        server_.listen();
+    }
+
+    void close() {
+        server_.close();
+    }
+
+private:
+    MQTT_NS::server_uring<> server_;
+    MQTT_NS::broker::broker_t& b_;
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( pubsub ) {
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_uring> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_clean_session(true);
+    c1->set_client_id("cid1");
+
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c2->set_clean_session(true);
+    c2->set_client_id("cid2");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c1)>::packet_id_t;
+
+    // larger than the send and the receive buffers
+    std::string large(100 * 1024, 'x');
+    for (std::size_t i = 0; i != large.size(); ++i) large[i] = static_cast<char>('a' + i % 26);
+
+    checker chk = {
+        cont("c1_h_connack"),
+        cont("c1_h_suback"),
+        cont("c2_h_connack"),
+        cont("c1_h_publish1"),
+        cont("c1_h_publish2"),
+        cont("c1_h_publish3"),
+        cont("c2_h_close"),
+        cont("c1_h_close"),
+    };
+
+    c1->set_connack_handler(
+        [&chk, &c1]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("c1_h_connack");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c1->subscribe("topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        }
+    );
+    c1->set_suback_handler(
+        [&chk, &c2]
+        (packet_id_t, std::vector<MQTT_NS::suback_return_code>) {
+            MQTT_CHK("c1_h_suback");
+            c2->connect();
+            return true;
+        }
+    );
+    c2->set_connack_handler(
+        [&chk, &c2, &large]
+        (bool, MQTT_NS::connect_return_code) {
+            MQTT_CHK("c2_h_connack");
+            c2->publish("topic1", "topic1_contents1", MQTT_NS::qos::at_most_once);
+            c2->publish("topic1", large, MQTT_NS::qos::at_least_once);
+            c2->publish("topic1", "topic1_contents3", MQTT_NS::qos::at_least_once);
+            return true;
+        }
+    );
+    c1->set_publish_handler(
+        [&chk, &c2, &large]
+        (MQTT_NS::optional<packet_id_t>,
+         MQTT_NS::publish_options,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents) {
+            BOOST_TEST(topic == "topic1");
+            auto ret = chk.match(
+                "c2_h_connack",
+                [&] {
+                    MQTT_CHK("c1_h_publish1");
+                    BOOST_TEST(contents == "topic1_contents1");
+                },
+                "c1_h_publish1",
+                [&] {
+                    MQTT_CHK("c1_h_publish2");
+                    BOOST_TEST(contents == large);
+                },
+                "c1_h_publish2",
+                [&] {
+                    MQTT_CHK("c1_h_publish3");
+                    BOOST_TEST(contents == "topic1_contents3");
+                    c2->disconnect();
+                }
+            );
+            BOOST_TEST(ret);
+            return true;
+        }
+    );
+    c2->set_close_handler(
+        [&chk, &c1]
+        () {
+            MQTT_CHK("c2_h_close");
+            c1->disconnect();
+        }
+    );
+    c1->set_close_handler(
+        [&chk, &finish]
+        () {
+            MQTT_CHK("c1_h_close");
+            finish();
+        }
+    );
+    c1->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+    c2->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c1->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+}
+
+BOOST_AUTO_TEST_CASE( takeover ) {
+
+    //
+    // c1 and c2 connect with the same client id.
+    // The broker closes c1 by force.
+    //
+
+    boost::asio::io_context iocb;
+    MQTT_NS::broker::broker_t b(iocb);
+    MQTT_NS::optional<test_server_uring> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(iocb, b);
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    auto finish =
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        };
+
+    boost::asio::io_context ioc;
+
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_clean_session(true);
+    c1->set_client_id("cid1");
+
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c2->set_clean_session(true);
+    c2->set_client_id("cid1");
+
+    checker chk = {
+        cont("c1_h_connack"),
+        deps("c2_h_connack", "c1_h_connack"),
+        deps("c1_h_error", "c1_h_connack"),
+        deps("c2_h_close", "c2_h_connack", "c1_h_error"),
+    };
+
+    c1->set_connack_handler(
+        [&chk, &c2]
+        (bool, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("c1_h_connack");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c2->connect();
+            return true;
+        }
+    );
+    bool c1_closed = false;
+    bool c2_connected = false;
+    auto disconnect_c2 =
+        [&] {
+            if (c1_closed && c2_connected) c2->disconnect();
+        };
+    c1->set_error_handler(
+        [&]
+        (MQTT_NS::error_code) {
+            MQTT_CHK("c1_h_error");
+            c1_closed = true;
+            disconnect_c2();
+        }
+    );
+    c2->set_connack_handler(
+        [&]
+        (bool, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("c2_h_connack");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c2_connected = true;
+            disconnect_c2();
+            return true;
+        }
+    );
+    c2->set_close_handler(
+        [&chk, &finish]
+        () {
+            MQTT_CHK("c2_h_close");
+            finish();
+        }
+    );
+    c2->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        }
+    );
+
+    c1->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    th.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
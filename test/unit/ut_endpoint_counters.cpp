@@ -0,0 +1,94 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common/test_main.hpp"
+#include "../common/global_fixture.hpp"
+
+#include <mqtt/endpoint_counters.hpp>
+
+BOOST_AUTO_TEST_SUITE(ut_endpoint_counters)
+
+BOOST_AUTO_TEST_CASE( packets ) {
+    MQTT_NS::endpoint_counters c;
+    c.packet_sent(MQTT_NS::control_packet_type::connect);
+    c.packet_sent(MQTT_NS::control_packet_type::publish);
+    c.packet_sent(MQTT_NS::control_packet_type::publish);
+    c.packet_received(MQTT_NS::control_packet_type::connack, 4);
+    c.packet_received(MQTT_NS::control_packet_type::auth, 1);
+    c.add_bytes_sent(10);
+
+    BOOST_TEST(c.packets_sent(MQTT_NS::control_packet_type::connect) == 1U);
+    BOOST_TEST(c.packets_sent(MQTT_NS::control_packet_type::publish) == 2U);
+    BOOST_TEST(c.packets_received(MQTT_NS::control_packet_type::connack) == 1U);
+
+    auto s = c.get_snapshot();
+    BOOST_TEST(s.sent(MQTT_NS::control_packet_type::publish) == 2U);
+    BOOST_TEST(s.received(MQTT_NS::control_packet_type::auth) == 1U);
+    BOOST_TEST(s.total_packets_sent() == 3U);
+    BOOST_TEST(s.total_packets_received() == 2U);
+    BOOST_TEST(s.bytes_sent == 10U);
+    BOOST_TEST(s.bytes_received == 5U);
+}
+
+BOOST_AUTO_TEST_CASE( queue ) {
+    MQTT_NS::endpoint_counters c;
+    c.enqueued(10, false);
+    c.enqueued(20, true);
+    c.enqueued(30, true);
+    BOOST_TEST(c.queue_depth() == 3U);
+    BOOST_TEST(c.queue_bytes() == 60U);
+    BOOST_TEST(c.write_stalls() == 2U);
+    c.dequeued(10);
+    c.dequeued(20);
+    BOOST_TEST(c.queue_depth() == 1U);
+    BOOST_TEST(c.queue_bytes() == 30U);
+    BOOST_TEST(c.peak_queue_depth() == 3U);
+    c.reset_peak_queue_depth();
+    BOOST_TEST(c.peak_queue_depth() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( group ) {
+    auto g = std::make_shared<MQTT_NS::endpoint_counters_group>();
+    {
+        MQTT_NS::endpoint_counters c1;
+        MQTT_NS::endpoint_counters c2;
+        g->add(c1);
+        g->add(c2);
+        BOOST_TEST(g->size() == 2U);
+
+        c1.packet_sent(MQTT_NS::control_packet_type::publish);
+        c2.packet_sent(MQTT_NS::control_packet_type::publish);
+        c1.packet_received(MQTT_NS::control_packet_type::puback, 3);
+        c2.packet_received(MQTT_NS::control_packet_type::pubrec, 4);
+        c1.enqueued(10, false);
+        c2.enqueued(20, false);
+        c2.enqueued(20, true);
+        c1.set_store_size(3);
+        c2.set_store_size(2);
+
+        auto s = g->get_snapshot();
+        BOOST_TEST(s.sent(MQTT_NS::control_packet_type::publish) == 2U);
+        BOOST_TEST(s.total_packets_received() == 2U);
+        BOOST_TEST(s.bytes_received == 7U);
+        BOOST_TEST(s.queue_depth == 3U);
+        BOOST_TEST(s.queue_bytes == 50U);
+        BOOST_TEST(s.peak_queue_depth == 2U);
+        BOOST_TEST(s.store_size == 5U);
+        BOOST_TEST(s.write_stalls == 1U);
+    }
+    BOOST_TEST(g->size() == 0U);
+    auto s = g->get_snapshot();
+    // gauges of destroyed counters are dropped
+    BOOST_TEST(s.queue_depth == 0U);
+    BOOST_TEST(s.queue_bytes == 0U);
+    BOOST_TEST(s.store_size == 0U);
+    // accumulated counters remain
+    BOOST_TEST(s.sent(MQTT_NS::control_packet_type::publish) == 2U);
+    BOOST_TEST(s.bytes_received == 7U);
+    BOOST_TEST(s.write_stalls == 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+// Copyright Takatoshi Kondo 2021
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_USE_LATENCY_HISTOGRAM)
+#define MQTT_USE_LATENCY_HISTOGRAM
+#endif // !defined(MQTT_USE_LATENCY_HISTOGRAM)
+
+#include "../common/test_main.hpp"
+#include "../common/global_fixture.hpp"
+
+#include <mqtt/latency_histogram.hpp>
+#include <mqtt/endpoint_counters.hpp>
+
+BOOST_AUTO_TEST_SUITE(ut_latency_histogram)
+
+using hist = MQTT_NS::latency_histogram;
+
+BOOST_AUTO_TEST_CASE( bucket ) {
+    hist::value_type const sub_bucket_count = hist::sub_bucket_count;
+    // linear region
+    for (hist::value_type v = 0; v != hist::sub_bucket_count * 2; ++v) {
+        BOOST_TEST(hist::bucket_index(v) == v);
+        BOOST_TEST(hist::bucket_lower(v) == v);
+    }
+    // log-linear region
+    for (hist::value_type v = 1; v < (hist::value_type(1) << 20); v = v * 3 + 1) {
+        auto i = hist::bucket_index(v);
+        BOOST_TEST(hist::bucket_lower(i) <= v);
+        BOOST_TEST(v <= hist::bucket_upper(i));
+        BOOST_TEST(hist::bucket_upper(i) + 1 == hist::bucket_lower(i + 1));
+        if (v >= sub_bucket_count) {
+            auto width = hist::bucket_upper(i) - hist::bucket_lower(i) + 1;
+            BOOST_TEST(width * sub_bucket_count <= v);
+        }
+    }
+    // overflow
+    BOOST_TEST(hist::bucket_index(hist::value_type(1) << hist::max_magnitude) == hist::bucket_count - 1);
+    BOOST_TEST(hist::bucket_index(~hist::value_type(0)) == hist::bucket_count - 1);
+    BOOST_TEST(hist::bucket_index((hist::value_type(1) << hist::max_magnitude) - 1) == hist::bucket_count - 1);
+}
+
+BOOST_AUTO_TEST_CASE( percentile ) {
+    hist h;
+    BOOST_TEST(h.get_snapshot().percentile(50) == 0U);
+    for (hist::value_type v = 1; v <= 1000; ++v) {
+        h.record(v * 1000);
+    }
+    h.record(std::chrono::milliseconds(-1));
+    auto s = h.get_snapshot();
+    BOOST_TEST(s.count == 1001U);
+    BOOST_TEST(s.max == 1000000U);
+    BOOST_TEST(s.counts[0] == 1U);
+    BOOST_TEST(s.mean() == 500000U);
+    auto p50 = s.percentile(50);
+    BOOST_TEST(p50 >= 500000U);
+    BOOST_TEST(p50 <= 500000U + 500000U / hist::sub_bucket_count);
+    auto p99 = s.percentile(99);
+    BOOST_TEST(p99 >= 990000U);
+    BOOST_TEST(p99 <= 1000000U);
+    BOOST_TEST(s.percentile(100) == 1000000U);
+}
+
+BOOST_AUTO_TEST_CASE( group ) {
+    auto g = std::make_shared<MQTT_NS::endpoint_counters_group>();
+    {
+        MQTT_NS::endpoint_counters c1;
+        MQTT_NS::endpoint_counters c2;
+        g->add(c1);
+        g->add(c2);
+        c1.send_latency().record(std::chrono::microseconds(10));
+        c2.send_latency().record(std::chrono::microseconds(20));
+        c2.process_latency().record(std::chrono::microseconds(30));
+
+        auto s = g->get_snapshot();
+        BOOST_TEST(s.send_latency.count == 2U);
+        BOOST_TEST(s.send_latency.max == 20000U);
+        BOOST_TEST(s.process_latency.count == 1U);
+        BOOST_TEST(s.receive_latency.count == 0U);
+    }
+    // histograms of destroyed counters remain
+    auto s = g->get_snapshot();
+    BOOST_TEST(s.send_latency.count == 2U);
+    BOOST_TEST(s.send_latency.sum == 30000U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
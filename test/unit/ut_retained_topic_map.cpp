@@ -112,6 +112,23 @@ BOOST_AUTO_TEST_CASE(general) {
     BOOST_TEST(map.internal_size() == 1);
 }
 
+BOOST_AUTO_TEST_CASE(replaced_and_erased_value) {
+    MQTT_NS::broker::retained_topic_map<std::string> map;
+    std::vector<std::string> values;
+    auto collect = [&](std::string const& v) { values.push_back(v); };
+
+    BOOST_TEST(map.insert_or_assign("a/b", "123", collect) == 1);
+    BOOST_TEST(values.empty());
+    BOOST_TEST(map.insert_or_assign("a/b", "4567", collect) == 0);
+    BOOST_TEST((values == std::vector<std::string>{ "123" }));
+
+    BOOST_TEST(map.erase("a", collect) == 0);
+    BOOST_TEST(values.size() == 1);
+    BOOST_TEST(map.erase("a/b", collect) == 1);
+    BOOST_TEST((values == std::vector<std::string>{ "123", "4567" }));
+    BOOST_TEST(map.size() == 0);
+}
+
 BOOST_AUTO_TEST_CASE(erase_lower_first) {
     MQTT_NS::broker::retained_topic_map<std::string> map;
     map.insert_or_assign("a/b/c", "1");
@@ -254,4 +271,24 @@ BOOST_AUTO_TEST_CASE(large_number_of_topics) {
     BOOST_TEST(map.internal_size() == 1);
 }
 
+BOOST_AUTO_TEST_CASE(system_topics) {
+    MQTT_NS::broker::retained_topic_map<std::string> map;
+    map.insert_or_assign("$SYS/broker/uptime", "1");
+    map.insert_or_assign("a/broker/uptime", "2");
+    map.insert_or_assign("$share/broker/uptime", "3");
+    map.insert_or_assign("b/broker/uptime", "4");
+
+    auto match =
+        [&](MQTT_NS::string_view filter) {
+            std::set<std::string> matches;
+            map.find(filter, [&](std::string const& v) { matches.insert(v); });
+            return matches;
+        };
+
+    BOOST_TEST((match("+/broker/uptime") == std::set<std::string>{ "2", "4" }));
+    BOOST_TEST((match("#") == std::set<std::string>{ "2", "4" }));
+    BOOST_TEST((match("$SYS/#") == std::set<std::string>{ "1" }));
+    BOOST_TEST((match("$SYS/+/uptime") == std::set<std::string>{ "1" }));
+}
+
 BOOST_AUTO_TEST_SUITE_END()